@@ -0,0 +1,74 @@
+/*
+ESPBitmap Library - host build
+Copyright 2018 Rickey Ward
+
+MIT License, see LICENSE in the root of the library.
+*/
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial;
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+unsigned long millis()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield()
+{
+  std::this_thread::yield();
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while(size--)
+    n += write(*buffer++);
+  return n;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+  size_t count = 0;
+  unsigned long startMs = millis();
+  while(count < length){
+    int c = read();
+    if(c < 0){
+      if(millis() - startMs >= timeout)
+        break;
+      yield();
+      continue;
+    }
+    buffer[count++] = (char)c;
+  }
+  return count;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  if(!started)
+    return 0;
+  return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  if(!started)
+    return 0;
+  return fwrite(buffer, 1, size, stdout);
+}
@@ -0,0 +1,106 @@
+/*
+ESPBitmap Library - host build
+Copyright 2018 Rickey Ward
+
+MIT License, see LICENSE in the root of the library.
+*/
+
+//just enough of the Arduino core for the library to build and run on a desktop machine.
+//this is only for measuring and debugging the decoders, it is not a general purpose Arduino emulation.
+
+#ifndef _ESPBITMAP_HOST_ARDUINO_H_
+#define _ESPBITMAP_HOST_ARDUINO_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#define PROGMEM
+#define F(x) (x)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+class String
+{
+  public:
+    String() {}
+    String(const char *s) : text(s) {}
+    String(const std::string &s) : text(s) {}
+    String(int value) : text(std::to_string(value)) {}
+
+    const char *c_str() const { return text.c_str(); }
+    unsigned int length() const { return text.length(); }
+    bool operator==(const String &other) const { return text == other.text; }
+    bool operator!=(const String &other) const { return text != other.text; }
+    String &operator+=(const String &other) { text += other.text; return *this; }
+
+    std::string text;
+};
+
+inline String operator+(const String &a, const String &b) { return String(a.text + b.text); }
+inline String operator+(const char *a, const String &b) { return String(a + b.text); }
+inline String operator+(const String &a, const char *b) { return String(a.text + b); }
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+
+    size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+    size_t print(const String &s) { return print(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char n) { return print((unsigned long)n); }
+    size_t print(int n) { return print((long)n); }
+    size_t print(unsigned int n) { return print((unsigned long)n); }
+    size_t print(long n) { return print(std::to_string(n).c_str()); }
+    size_t print(unsigned long n) { return print(std::to_string(n).c_str()); }
+    size_t print(double n) { return print(std::to_string(n).c_str()); }
+
+    template<typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+    size_t println() { return print("\r\n"); }
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t write(uint8_t) { return 0; }
+
+    //like the ESP8266 core, blocks until length bytes arrived or the timeout (1 second by default) passes.
+    virtual size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+    void setTimeout(unsigned long timeoutMs) { timeout = timeoutMs; }
+
+  protected:
+    unsigned long timeout = 1000;
+};
+
+//writes to stdout, but only once begin() was called, so library debug output costs next to nothing otherwise.
+class HardwareSerial : public Stream
+{
+  public:
+    void begin(unsigned long) { started = true; }
+    void end() { started = false; }
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+
+  private:
+    bool started = false;
+};
+
+extern HardwareSerial Serial;
+
+#endif /*_ESPBITMAP_HOST_ARDUINO_H_*/
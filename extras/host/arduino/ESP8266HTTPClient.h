@@ -0,0 +1,32 @@
+/*
+ESPBitmap Library - host build
+Copyright 2018 Rickey Ward
+
+MIT License, see LICENSE in the root of the library.
+*/
+
+//there is no network on the host build, every request fails. it only exists so ESPBitmapHTTPTransport compiles.
+
+#ifndef _ESPBITMAP_HOST_HTTPCLIENT_H_
+#define _ESPBITMAP_HOST_HTTPCLIENT_H_
+
+#include <Arduino.h>
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_NOT_MODIFIED 304
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+
+class HTTPClient
+{
+  public:
+    bool begin(const String &) { return false; }
+    void addHeader(const String &, const String &) {}
+    void collectHeaders(const char *[], size_t) {}
+    String header(const char *) { return String(); }
+    int GET() { return HTTPC_ERROR_CONNECTION_REFUSED; }
+    int getSize() { return -1; }
+    Stream *getStreamPtr() { return 0; }
+    void end() {}
+};
+
+#endif /*_ESPBITMAP_HOST_HTTPCLIENT_H_*/
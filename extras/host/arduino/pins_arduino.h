@@ -0,0 +1 @@
+//host build: nothing to map.
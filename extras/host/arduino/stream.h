@@ -0,0 +1,2 @@
+//host build: Stream lives in Arduino.h.
+#include <Arduino.h>
@@ -0,0 +1,1308 @@
+/*
+ESPBitmap Library - host benchmark
+Copyright 2018 Rickey Ward
+
+MIT License, see LICENSE in the root of the library.
+*/
+
+//decodes synthetic bitmaps of every supported format and size and reports how fast each way of
+//loading and reading them is, along with the most heap each load needed at once, then how many
+//allocations reloading takes, how badly it breaks up a small heap, and what a bitmap cache and
+//conditional fetches save, and how a decode speeds up split across threads.
+//
+//  espbitmap_bench [--quick] [--stats] [minimum ms per measurement]
+//
+//--stats also prints ESPBitmapBase::stats of one getFromStream load of each image (needs ESPBITMAP_STATS).
+
+#include <Arduino.h>
+#include <ESPBitmap.h>
+#include <ESPBitmap16.h>
+#include <ESPBitmapFile.h>
+#include <ESPBitmapCache.h>
+#include <ESPBitmapTransport.h>
+#include <stdio.h>
+#include <math.h>
+#include <new>
+#include <chrono>
+#include <vector>
+#include <mutex>
+#include <thread>
+
+//a small first fit heap in a fixed buffer, like the one on the ESP8266, so we can see it break up.
+class SimulatedHeap
+{
+  public:
+    SimulatedHeap(size_t bytes) : memory(bytes & ~(size_t)7)
+    {
+      Header *first = (Header *)memory.data();
+      first->size = memory.size();
+      first->used = 0;
+    }
+
+    bool owns(void *ptr) { return ptr >= memory.data() && ptr < memory.data() + memory.size(); }
+
+    void *allocate(size_t bytes)
+    {
+      size_t size = sizeof(Header) + ((bytes + 7) & ~(size_t)7);
+      for(Header *block = first(); block != 0; block = next(block)){
+        if(block->used)
+          continue;
+        //free neighbours are joined as they're passed.
+        for(Header *after = next(block); after != 0 && !after->used; after = next(block))
+          block->size += after->size;
+        if(block->size < size)
+          continue;
+        if(block->size - size >= 2 * sizeof(Header)){
+          Header *rest = (Header *)((uint8_t *)block + size);
+          rest->size = block->size - size;
+          rest->used = 0;
+          block->size = size;
+        }
+        block->used = 1;
+        return block + 1;
+      }
+      return 0;
+    }
+
+    void release(void *ptr) { ((Header *)ptr - 1)->used = 0; }
+
+    //free bytes in all, and in the biggest piece that could be handed out in one go.
+    size_t freeBytes()
+    {
+      size_t total = 0;
+      for(Header *block = first(); block != 0; block = next(block))
+        if(!block->used)
+          total += block->size - sizeof(Header);
+      return total;
+    }
+
+    size_t largestFree()
+    {
+      size_t largest = 0, run = 0;
+      for(Header *block = first(); block != 0; block = next(block)){
+        run = block->used ? 0 : run + block->size;
+        if(run > largest)
+          largest = run;
+      }
+      return largest > sizeof(Header) ? largest - sizeof(Header) : 0;
+    }
+
+  private:
+    struct Header { size_t size; size_t used; };
+    Header *first() { return (Header *)memory.data(); }
+    Header *next(Header *block)
+    {
+      uint8_t *after = (uint8_t *)block + block->size;
+      return after < memory.data() + memory.size() ? (Header *)after : 0;
+    }
+
+    std::vector<uint8_t> memory;
+};
+
+//every allocation is counted, so we can report peak heap use of a decode and how many blocks a load asks for.
+//while simulatedHeap is set allocations come out of it instead, and fail the way they would on the device.
+static size_t heapCurrent = 0;
+static size_t heapPeak = 0;
+static size_t heapAllocations = 0;
+static SimulatedHeap *simulatedHeap = 0;
+//parallel decodes start and end threads, which allocate and free on their own.
+static std::mutex heapLock;
+
+static void *countedAlloc(size_t size)
+{
+  std::lock_guard<std::mutex> lock(heapLock);
+  heapAllocations++;
+  if(simulatedHeap != 0){
+    void *ptr = simulatedHeap->allocate(size);
+    if(ptr == 0)
+      throw std::bad_alloc();
+    return ptr;
+  }
+  size_t *block = (size_t *)malloc(size + sizeof(max_align_t));
+  if(block == 0)
+    throw std::bad_alloc();
+  block[0] = size;
+  heapCurrent += size;
+  if(heapCurrent > heapPeak)
+    heapPeak = heapCurrent;
+  return (uint8_t *)block + sizeof(max_align_t);
+}
+
+static void countedFree(void *ptr)
+{
+  if(ptr == 0)
+    return;
+  std::lock_guard<std::mutex> lock(heapLock);
+  if(simulatedHeap != 0 && simulatedHeap->owns(ptr)){
+    simulatedHeap->release(ptr);
+    return;
+  }
+  size_t *block = (size_t *)((uint8_t *)ptr - sizeof(max_align_t));
+  heapCurrent -= block[0];
+  free(block);
+}
+
+void *operator new(size_t size) { return countedAlloc(size); }
+void *operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void *ptr) noexcept { countedFree(ptr); }
+void operator delete[](void *ptr) noexcept { countedFree(ptr); }
+void operator delete(void *ptr, size_t) noexcept { countedFree(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { countedFree(ptr); }
+
+static double now();
+
+//hands out a file a chunk at a time, like packets arriving over wifi.
+//callCost makes every call take at least that many seconds, like a WiFiClient or SD File does.
+class MemoryStream : public Stream
+{
+  public:
+    MemoryStream(const std::vector<uint8_t> &file, size_t chunkSize, double callCost = 0)
+      : data(file.data()), length(file.size()), chunk(chunkSize), cost(callCost) {}
+
+    int available() { overhead(); size_t left = length - position; return (int)(left > chunk ? chunk : left); }
+    int read() { overhead(); return position < length ? data[position++] : -1; }
+    int peek() { overhead(); return position < length ? data[position] : -1; }
+    size_t readBytes(char *buffer, size_t count)
+    {
+      overhead();
+      if(count > length - position)
+        count = length - position;
+      memcpy(buffer, data + position, count);
+      position += count;
+      return count;
+    }
+
+  private:
+    void overhead()
+    {
+      if(cost > 0){
+        double until = now() + cost;
+        while(now() < until);
+      }
+    }
+
+    const uint8_t *data;
+    size_t length;
+    size_t position = 0;
+    size_t chunk;
+    double cost;
+};
+
+//a stream over a link of bytesPerSecond, each read waits until the link could have delivered it. the link only
+//runs ahead by a TCP window (4 packets, like the ESP8266's lwIP) while nobody reads, so time spent decoding
+//between reads is mostly lost to it.
+class ThrottledStream : public Stream
+{
+  public:
+    ThrottledStream(const std::vector<uint8_t> &file, size_t chunkSize, double bytesPerSecond)
+      : data(file.data()), length(file.size()), chunk(chunkSize), rate(bytesPerSecond) {}
+
+    int available() { size_t left = length - position; return (int)(left > chunk ? chunk : left); }
+    int read() { wait(1); return position < length ? data[position++] : -1; }
+    int peek() { return position < length ? data[position] : -1; }
+    size_t readBytes(char *buffer, size_t count)
+    {
+      if(count > length - position)
+        count = length - position;
+      wait(count);
+      memcpy(buffer, data + position, count);
+      position += count;
+      return count;
+    }
+
+  private:
+    //the packets are microseconds apart at these rates, too close for sleeps, so it spins letting other threads run.
+    void wait(size_t count)
+    {
+      double t = now();
+      double window = 4 * 1460 / rate;
+      if(arrival < t - window)
+        arrival = t - window;
+      arrival += count / rate;
+      while(now() < arrival)
+        std::this_thread::yield();
+    }
+
+    const uint8_t *data;
+    size_t length;
+    size_t position = 0;
+    size_t chunk;
+    double rate;
+    double arrival = 0;
+};
+
+//------------------------------------------------------------------ synthetic bitmaps
+
+struct TestImage {
+  char name[24];
+  int width;
+  int height;
+  std::vector<uint8_t> file;
+};
+
+static void put16(std::vector<uint8_t> &v, size_t offset, uint16_t value)
+{
+  v[offset] = value;
+  v[offset + 1] = value >> 8;
+}
+
+static void put32(std::vector<uint8_t> &v, size_t offset, uint32_t value)
+{
+  for(int i = 0; i < 4; i++)
+    v[offset + i] = value >> (8 * i);
+}
+
+static uint32_t randomState = 12345;
+static uint8_t randomByte()
+{
+  randomState = randomState * 1103515245 + 12345;
+  return randomState >> 16;
+}
+
+//palette index of a pixel, flat blocks with some noise so RLE has both runs and absolute runs to do.
+static uint8_t indexAt(int x, int y, int bitsPerPixel)
+{
+  int colors = 1 << bitsPerPixel;
+  uint8_t index = ((x / 16) + (y / 16) * 3) % colors;
+  if(((x ^ y) & 31) == 0)
+    index = randomByte() % colors;
+  return index;
+}
+
+//appends one row of palette indexes as RLE4 or RLE8 codes.
+static void encodeRLERow(std::vector<uint8_t> &out, const uint8_t *row, int width, int bitsPerPixel)
+{
+  int x = 0;
+  while(x < width){
+    int run = 1;
+    while(x + run < width && run < 255 && row[x + run] == row[x])
+      run++;
+    if(run >= 3 || width - x < 3){
+      out.push_back(run);
+      out.push_back(bitsPerPixel == 8 ? row[x] : (row[x] << 4) | row[x]);
+      x += run;
+      continue;
+    }
+    //absolute run up to the next repeat.
+    int count = 0;
+    while(x + count < width && count < 255
+          && !(x + count + 2 < width && row[x + count] == row[x + count + 1] && row[x + count] == row[x + count + 2]))
+      count++;
+    if(count < 3)
+      count = (width - x < 3) ? width - x : 3;
+    out.push_back(0);
+    out.push_back(count);
+    size_t bytes = 0;
+    for(int i = 0; i < count; i += (bitsPerPixel == 8 ? 1 : 2), bytes++){
+      if(bitsPerPixel == 8)
+        out.push_back(row[x + i]);
+      else
+        out.push_back((row[x + i] << 4) | (i + 1 < count ? row[x + i + 1] : 0));
+    }
+    if(bytes & 1)
+      out.push_back(0);
+    x += count;
+  }
+  out.push_back(0);
+  out.push_back(0);
+}
+
+//masks is 0 for the default layout of the bit depth, otherwise the file gets BI_BITFIELDS masks.
+static TestImage makeImage(const char *name, int width, int height, int bitsPerPixel, int compression, const uint32_t *masks)
+{
+  TestImage image;
+  snprintf(image.name, sizeof(image.name), "%s", name);
+  image.width = width;
+  image.height = height;
+
+  size_t colors = bitsPerPixel <= 8 ? (1 << bitsPerPixel) : 0;
+  size_t maskBytes = masks ? 12 : 0;
+  size_t headerEnd = 14 + 40 + maskBytes + colors * 4;
+  size_t scanlineWidth = 4 * ((width * bitsPerPixel + 31) / 32);
+
+  std::vector<uint8_t> pixels;
+  if(compression == BI_RLE_8 || compression == BI_RLE_4){
+    std::vector<uint8_t> row(width);
+    for(int r = 0; r < height; r++){
+      for(int x = 0; x < width; x++)
+        row[x] = indexAt(x, r, bitsPerPixel);
+      encodeRLERow(pixels, row.data(), width, bitsPerPixel);
+    }
+    pixels.push_back(0);
+    pixels.push_back(1);
+  }
+  else{
+    pixels.assign(scanlineWidth * height, 0);
+    for(int r = 0; r < height; r++){
+      uint8_t *row = pixels.data() + scanlineWidth * r;
+      if(bitsPerPixel <= 8){
+        for(int x = 0; x < width; x++){
+          int bit = x * bitsPerPixel;
+          row[bit / 8] |= indexAt(x, r, bitsPerPixel) << (8 - bitsPerPixel - bit % 8);
+        }
+      }
+      else{
+        for(size_t i = 0; i < (size_t)width * bitsPerPixel / 8; i++)
+          row[i] = randomByte();
+      }
+    }
+  }
+
+  image.file.assign(headerEnd, 0);
+  image.file[0] = 'B';
+  image.file[1] = 'M';
+  put32(image.file, 10, headerEnd);
+  put32(image.file, 14, 40);
+  put32(image.file, 18, width);
+  put32(image.file, 22, height);
+  put16(image.file, 26, 1);
+  put16(image.file, 28, bitsPerPixel);
+  put32(image.file, 30, compression);
+  put32(image.file, 34, pixels.size());
+  for(size_t i = 0; i < maskBytes / 4; i++)
+    put32(image.file, 54 + 4 * i, masks[i]);
+  for(size_t i = 0; i < colors * 4; i++)
+    image.file[54 + maskBytes + i] = (i % 4 == 3) ? 0 : randomByte();
+  image.file.insert(image.file.end(), pixels.begin(), pixels.end());
+  put32(image.file, 2, image.file.size());
+  return image;
+}
+
+//rewrites the pixels of an uncompressed 8, 24 or 32bpp image to use only the first colors of a fixed set, in flat blocks.
+static TestImage withColors(TestImage image, int colors)
+{
+  int bitsPerPixel = image.file[28];
+  size_t offset = image.file[10] | (image.file[11] << 8);
+  size_t scanlineWidth = 4 * ((image.width * bitsPerPixel + 31) / 32);
+  int bytes = bitsPerPixel / 8;
+  for(int r = 0; r < image.height; r++){
+    uint8_t *row = image.file.data() + offset + scanlineWidth * r;
+    for(int x = 0; x < image.width; x++){
+      uint8_t index = indexAt(x, r, 8) % colors;
+      for(int i = 0; i < bytes; i++)
+        row[x * bytes + i] = bytes == 1 ? index : (uint8_t)(index * (37 + 50 * i) + 11 * i);
+    }
+  }
+  snprintf(image.name + strlen(image.name), sizeof(image.name) - strlen(image.name), " %d colors", colors);
+  return image;
+}
+
+//rewrites the pixels of an uncompressed 24bpp image as smooth gradients, more like a photo than noise is.
+static TestImage withGradient(TestImage image)
+{
+  size_t offset = image.file[10] | (image.file[11] << 8);
+  size_t scanlineWidth = 4 * ((image.width * 24 + 31) / 32);
+  for(int r = 0; r < image.height; r++){
+    uint8_t *row = image.file.data() + offset + scanlineWidth * r;
+    for(int x = 0; x < image.width; x++){
+      row[3 * x] = x * 255 / image.width;
+      row[3 * x + 1] = r * 255 / image.height;
+      row[3 * x + 2] = (x + r) * 127 / (image.width + image.height) + (((x / 40) + (r / 30)) & 1) * 128;
+    }
+  }
+  snprintf(image.name + strlen(image.name), sizeof(image.name) - strlen(image.name), " gradient");
+  return image;
+}
+
+//rewrites the 4th byte of an uncompressed 32bpp image as the alpha of an icon: a disc with a soft edge, or a
+//thin ring of one with everything inside and around it transparent.
+static TestImage withAlpha(TestImage image, bool ring)
+{
+  size_t offset = image.file[10] | (image.file[11] << 8);
+  int radius = (image.width < image.height ? image.width : image.height) / 2 - 1;
+  for(int r = 0; r < image.height; r++){
+    uint8_t *row = image.file.data() + offset + 4 * image.width * r;
+    for(int x = 0; x < image.width; x++){
+      int dx = x - image.width / 2, dy = r - image.height / 2;
+      int edge = radius * radius - (dx * dx + dy * dy);
+      int alpha = edge >= 2 * radius ? 255 : edge <= 0 ? 0 : edge * 255 / (2 * radius);
+      if(ring && edge > 8 * radius)
+        alpha = 0;
+      row[4 * x + 3] = alpha;
+    }
+  }
+  snprintf(image.name + strlen(image.name), sizeof(image.name) - strlen(image.name), ring ? " ring" : " disc");
+  return image;
+}
+
+//------------------------------------------------------------------ measuring
+
+static double minimumSeconds = 0.2;
+
+static double now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//runs work over and over for at least minimumSeconds, returns the seconds one run took.
+template<typename Work>
+static double timeIt(Work work)
+{
+  //the first run warms up, unless it's slow enough to be the measurement on its own.
+  double start = now();
+  work();
+  double elapsed = now() - start;
+  if(elapsed >= minimumSeconds)
+    return elapsed;
+  int runs = 0;
+  start = now();
+  do {
+    work();
+    runs++;
+    elapsed = now() - start;
+  } while(elapsed < minimumSeconds);
+  return elapsed / runs;
+}
+
+//most heap one run of work needed on top of what was already in use.
+template<typename Work>
+static size_t peakHeap(Work work)
+{
+  size_t base = heapCurrent;
+  heapPeak = heapCurrent;
+  work();
+  return heapPeak - base;
+}
+
+static volatile uint32_t sink;
+//generous, the bench measures how long streaming takes rather than testing timeouts.
+static const int streamTimeoutMs = 60000;
+
+static void checkResult(BITMAP_RESULT_t result, const char *what, const TestImage &image)
+{
+  if(result != BITMAP_SUCCESS){
+    fprintf(stderr, "%s failed with %d on %s %dx%d\n", what, (int)result, image.name, image.width, image.height);
+    exit(1);
+  }
+}
+
+static uint32_t pixelValue(PIXEL_t pixel) { return pixel.r + pixel.g + pixel.b; }
+static uint32_t pixelValue(uint16_t pixel) { return pixel; }
+
+static void scanlineSink(int y, PIXEL_t *pixels, int width) { sink += pixels[width - 1].g + y; }
+static void scanlineSink16(int y, uint16_t *pixels, int width) { sink += pixels[width - 1] + y; }
+
+template<typename Bitmap>
+static double decodeSeconds(TestImage &image, size_t &heap)
+{
+  auto decode = [&]() {
+    Bitmap bitmap;
+    checkResult(bitmap.DecodeFileBuffer(image.file.data(), image.file.size()), "DecodeFileBuffer", image);
+  };
+  heap = peakHeap(decode);
+  return timeIt(decode);
+}
+
+template<typename Bitmap>
+static double getPixelNanoseconds(TestImage &image)
+{
+  Bitmap bitmap;
+  checkResult(bitmap.DecodeFileBuffer(image.file.data(), image.file.size()), "DecodeFileBuffer", image);
+  double seconds = timeIt([&]() {
+    uint32_t total = 0;
+    for(int y = 0; y < image.height; y++)
+      for(int x = 0; x < image.width; x++)
+        total += pixelValue(bitmap.getPixel(x, y));
+    sink += total;
+  });
+  return seconds * 1e9 / ((double)image.width * image.height);
+}
+
+template<typename Bitmap>
+static double getFromStreamSeconds(TestImage &image, size_t chunk, size_t &heap, double callCost = 0)
+{
+  auto load = [&]() {
+    Bitmap bitmap;
+    MemoryStream stream(image.file, chunk, callCost);
+    checkResult(bitmap.getFromStream(&stream, image.file.size(), streamTimeoutMs), "getFromStream", image);
+  };
+  heap = peakHeap(load);
+  return timeIt(load);
+}
+
+static double streamDecodeSeconds(TestImage &image, size_t chunk, size_t &heap)
+{
+  auto decode = [&]() {
+    ESPBitmap bitmap;
+    MemoryStream stream(image.file, chunk);
+    checkResult(bitmap.StreamDecode(&stream, image.file.size(), streamTimeoutMs, scanlineSink), "StreamDecode", image);
+  };
+  heap = peakHeap(decode);
+  return timeIt(decode);
+}
+
+static double streamDecode16Seconds(TestImage &image, size_t chunk)
+{
+  return timeIt([&]() {
+    ESPBitmap16 bitmap;
+    MemoryStream stream(image.file, chunk);
+    checkResult(bitmap.StreamDecode(&stream, image.file.size(), streamTimeoutMs, scanlineSink16), "StreamDecode", image);
+  });
+}
+
+#ifdef ESPBITMAP_STATS
+static void printStats(const TestImage &image)
+{
+  ESPBitmap bitmap;
+  MemoryStream stream(image.file, 1460, 1e-6);
+  checkResult(bitmap.getFromStream(&stream, image.file.size(), streamTimeoutMs), "getFromStream", image);
+  const BITMAP_STATS_t &stats = bitmap.stats;
+  printf("%-16s %4dx%-4d read %7u bytes in %5u calls, %3u stalls %6uus | header %5uus palette %5uus data %7uus | %2u allocs %7u bytes, peak %7u\n",
+         image.name, image.width, image.height,
+         stats.bytesRead, stats.readCalls, stats.stalls, stats.stallMicros,
+         stats.headerMicros, stats.paletteMicros, stats.dataMicros,
+         stats.allocations, stats.allocatedBytes, stats.peakBytes);
+}
+#endif
+
+//pans a 240x240 view across an image left in a file, a few pixels at a time like scrolling a map.
+static void fileBenchmark(TestImage &image, int cacheRows)
+{
+  FILE *file = tmpfile();
+  fwrite(image.file.data(), 1, image.file.size(), file);
+  ESPBitmapStdioSource source(file);
+  ESPBitmapFile bitmap;
+  bitmap.setCacheRows(cacheRows);
+  checkResult(bitmap.open(&source), "open", image);
+
+  static PIXEL_t view[240 * 240];
+  int step = 0;
+  double viewSeconds = timeIt([&]() {
+    int x = (step * 16) % (image.width - 240);
+    int y = ((step * 16) / (image.width - 240) * 16) % (image.height - 240);
+    step++;
+    bitmap.copyRect(x, y, 240, 240, view, 240);
+    sink += view[0].g;
+  });
+  uint32_t viewHits = bitmap.cacheHits, viewMisses = bitmap.cacheMisses;
+
+  //getPixel along a short random walk, like following a path drawn on the map.
+  bitmap.cacheHits = bitmap.cacheMisses = 0;
+  int x = image.width / 2, y = image.height / 2;
+  double walkSeconds = timeIt([&]() {
+    for(int i = 0; i < 1000; i++){
+      x += rand() % 3 - 1;
+      y += rand() % 3 - 1;
+      sink += bitmap.getPixel(x, y).g;
+    }
+  });
+  printf("%-16s %4dx%-4d %3d rows %6.1f KB | view %8.1f us %5.1f%% hits | getPixel walk %7.1f ns %5.1f%% hits\n",
+         image.name, image.width, image.height, cacheRows, cacheRows * bitmap.scanlineWidth / 1024.0,
+         viewSeconds * 1e6, 100.0 * viewHits / (viewHits + viewMisses),
+         walkSeconds * 1e9 / 1000, 100.0 * bitmap.cacheHits / (bitmap.cacheHits + bitmap.cacheMisses));
+  fclose(file);
+}
+
+//a slideshow: images of different sizes and formats loaded one after another, with the sketch keeping a few
+//small blocks of its own alive in between (strings, a response header...) the way real sketches do.
+//either a new bitmap each time, or one bitmap that's loaded again and keeps its memory.
+static void reloadBenchmark(std::vector<TestImage> &slides, bool reuse, bool separateStorage, int loads)
+{
+  //the time and number of allocations of a load, on the normal heap.
+  size_t index = 0;
+  ESPBitmap16 kept;
+  size_t allocationsBefore = heapAllocations;
+  auto load = [&]() {
+    TestImage &image = slides[index++ % slides.size()];
+    if(reuse){
+      checkResult(kept.DecodeFileBuffer(image.file.data(), image.file.size()), "DecodeFileBuffer", image);
+    }
+    else{
+      ESPBitmap16 *bitmap = new ESPBitmap16();
+      checkResult(bitmap->DecodeFileBuffer(image.file.data(), image.file.size()), "DecodeFileBuffer", image);
+      delete bitmap;
+    }
+  };
+  for(size_t i = 0; i < slides.size(); i++)
+    load();
+  allocationsBefore = heapAllocations;
+  for(size_t i = 0; i < slides.size(); i++)
+    load();
+  double allocationsPerLoad = (double)(heapAllocations - allocationsBefore) / slides.size();
+  double seconds = timeIt(load);
+
+  //the same slideshow in a 64KB heap, storage optionally coming from a second one like PSRAM.
+  SimulatedHeap heap(64 * 1024);
+  SimulatedHeap psram(256 * 1024);
+  int failures = 0;
+  size_t lowestLargest = (size_t)-1;
+  {
+    simulatedHeap = &heap;
+    ESPBitmap16 *bitmap = 0;
+    void *held[4] = { 0, 0, 0, 0 };
+    for(int i = 0; i < loads; i++){
+      TestImage &image = slides[i % slides.size()];
+      if(!reuse && bitmap != 0){
+        delete bitmap;
+        bitmap = 0;
+      }
+      try {
+        if(bitmap == 0){
+          bitmap = new ESPBitmap16();
+          if(separateStorage)
+            bitmap->setAllocator(
+              [](size_t bytes, void *context) { return ((SimulatedHeap *)context)->allocate(bytes); },
+              [](void *block, void *context) { ((SimulatedHeap *)context)->release(block); },
+              &psram);
+        }
+        if(bitmap->DecodeFileBuffer(image.file.data(), image.file.size()) != BITMAP_SUCCESS)
+          failures++;
+      }
+      catch(std::bad_alloc &){
+        failures++;
+      }
+      //the sketch's own blocks, each lives through a few loads.
+      if(held[i % 4] != 0)
+        operator delete(held[i % 4]);
+      try { held[i % 4] = operator new(24 + (i * 37) % 200); } catch(std::bad_alloc &) { held[i % 4] = 0; }
+      size_t largest = heap.largestFree();
+      if(largest < lowestLargest)
+        lowestLargest = largest;
+    }
+    size_t freeAtEnd = heap.freeBytes(), largestAtEnd = heap.largestFree();
+    for(void *block : held)
+      if(block != 0)
+        operator delete(block);
+    delete bitmap;
+    simulatedHeap = 0;
+
+    printf("%-26s %8.1f us %6.1f allocs/load | %d loads %3d failed | smallest largest free block %6.1f KB, at the end %6.1f of %6.1f KB free\n",
+           reuse ? (separateStorage ? "one bitmap, setAllocator" : "one bitmap, reloaded") : "new bitmap per load",
+           seconds * 1e6, allocationsPerLoad, loads, failures,
+           lowestLargest / 1024.0, largestAtEnd / 1024.0, freeAtEnd / 1024.0);
+  }
+}
+
+//a dashboard refreshing: every refresh draws a few icons, some much more often than others. each load is a
+//getFromStream from a stream taking 1us per call, standing in for the download fetchImageFromUrl would do.
+struct IconSet {
+  std::vector<TestImage> icons;
+  int loads;
+};
+
+static BITMAP_RESULT_t loadIcon(const char *key, ESPBitmap16 &bitmap, void *context)
+{
+  IconSet &set = *(IconSet *)context;
+  TestImage &icon = set.icons[atoi(key)];
+  set.loads++;
+  MemoryStream stream(icon.file, 1460, 1e-6);
+  return bitmap.getFromStream(&stream, icon.file.size(), streamTimeoutMs);
+}
+
+static void cacheBenchmark(IconSet &set, size_t budget)
+{
+  ESPBitmapCache<ESPBitmap16> cache(budget);
+  set.loads = 0;
+  int refreshes = 0;
+  double seconds = timeIt([&]() {
+    //icon i comes up about 1/(i+1) as often as the first.
+    for(int drawn = 0; drawn < 8; drawn++){
+      double total = 0;
+      for(size_t i = 0; i < set.icons.size(); i++)
+        total += 1.0 / (i + 1);
+      double pick = total * rand() / ((double)RAND_MAX + 1);
+      int index = 0;
+      while(index + 1 < (int)set.icons.size() && (pick -= 1.0 / (index + 1)) >= 0)
+        index++;
+      char key[12];
+      snprintf(key, sizeof(key), "%d", index);
+      ESPBitmap16 *icon;
+      if(budget == 0){
+        ESPBitmap16 bitmap;
+        checkResult(loadIcon(key, bitmap, &set), "getFromStream", set.icons[index]);
+        icon = &bitmap;
+        sink += icon->getPixel(0, 0);
+      }
+      else{
+        checkResult(cache.get(key, icon, loadIcon, &set), "cache get", set.icons[index]);
+        sink += icon->getPixel(0, 0);
+      }
+    }
+    refreshes++;
+  });
+  if(budget == 0)
+    printf("%-10s %8.1f us per refresh | %5.2f loads per refresh\n", "no cache", seconds * 1e6, (double)set.loads / refreshes);
+  else
+    printf("%6.1f KB  %8.1f us per refresh | %5.2f loads per refresh | %5.1f%% hits %6u evictions %6.1f KB in %d bitmaps\n",
+           budget / 1024.0, seconds * 1e6, (double)set.loads / refreshes,
+           100.0 * cache.hits / (cache.hits + cache.misses), cache.evictions, cache.bytesUsed() / 1024.0, cache.entryCount());
+}
+
+//an in process stand-in for a web server, answering conditional requests the way a real one does.
+//the body comes out of a MemoryStream at 1us per call, every image has a version that is its ETag and
+//its Last-Modified date.
+class StandInServer : public ESPBitmapTransport
+{
+  public:
+    std::vector<TestImage> images;
+    std::vector<int> versions;
+    size_t bytesSent = 0;
+    int notModified = 0;
+
+    int get(const String &url, const String &etag, const String &lastModified)
+    {
+      current = atoi(url.c_str() + 1);
+      if((etag.length() > 0 && etag == currentETag()) || (lastModified.length() > 0 && lastModified == currentLastModified())){
+        notModified++;
+        return HTTP_CODE_NOT_MODIFIED;
+      }
+      body = new MemoryStream(images[current].file, 1460, 1e-6);
+      bytesSent += images[current].file.size();
+      return HTTP_CODE_OK;
+    }
+    Stream *stream() { return body; }
+    int size() { return images[current].file.size(); }
+    String etag() { return currentETag(); }
+    String lastModified() { return currentLastModified(); }
+    void end() { delete body; body = 0; }
+
+  private:
+    String currentETag() { return String("\"") + String(versions[current]) + "\""; }
+    String currentLastModified() { return String("version ") + String(versions[current]); }
+    int current = 0;
+    MemoryStream *body = 0;
+};
+
+//a dashboard fetching all of its images every refresh, where only some of them changed since the last one.
+static void conditionalFetchBenchmark(StandInServer &server, bool keepBitmaps, int changedPercent)
+{
+  std::vector<ESPBitmap16> kept(server.images.size());
+  for(ESPBitmap16 &bitmap : kept)
+    bitmap.setTransport(&server);
+  server.bytesSent = 0;
+  server.notModified = 0;
+  int refreshes = 0;
+  double seconds = timeIt([&]() {
+    for(size_t i = 0; i < server.images.size(); i++){
+      if(rand() % 100 < changedPercent)
+        server.versions[i]++;
+      String url = String("/") + String((int)i);
+      if(keepBitmaps){
+        checkResult(kept[i].fetchImageFromUrl(url), "fetchImageFromUrl", server.images[i]);
+        sink += kept[i].getPixel(0, 0);
+      }
+      else{
+        ESPBitmap16 bitmap;
+        bitmap.setTransport(&server);
+        checkResult(bitmap.fetchImageFromUrl(url), "fetchImageFromUrl", server.images[i]);
+        sink += bitmap.getPixel(0, 0);
+      }
+    }
+    refreshes++;
+  });
+  printf("%-22s %3d%% changed %8.1f us per refresh | %7.1f KB sent per refresh | %5.1f%% answered 304\n",
+         keepBitmaps ? "kept, conditional GET" : "new bitmap, plain GET", changedPercent,
+         seconds * 1e6, server.bytesSent / 1024.0 / refreshes,
+         100.0 * server.notModified / ((double)refreshes * server.images.size()));
+}
+
+//pushing a whole 240x240 frame to a panel in writePixels sized bursts, the way TFT_eSPI or Adafruit_GFX take them.
+//ESPBitmap16 rows need every pixel swapped to the panel's byte order on the way out, ESPBitmap16Swapped's are
+//already in it and copySpan fills each burst with straight copies.
+static void panelBenchmark(TestImage &image, int burst)
+{
+  ESPBitmap16 bitmap16;
+  ESPBitmap16Swapped swapped;
+  checkResult(bitmap16.DecodeFileBuffer(image.file.data(), image.file.size()), "decode", image);
+  checkResult(swapped.DecodeFileBuffer(image.file.data(), image.file.size()), "decode", image);
+
+  std::vector<uint16_t> buffer(burst);
+  uint32_t frame = (uint32_t)image.width * image.height;
+  double swapSeconds = timeIt([&]() {
+    for(int y = 0; y < image.height; y++){
+      for(int x = 0; x < image.width; x += burst){
+        int n = bitmap16.copyRow(y, x, burst < image.width - x ? burst : image.width - x, buffer.data());
+        for(int i = 0; i < n; i++)
+          buffer[i] = (buffer[i] >> 8) | (buffer[i] << 8);
+        sink += buffer[0];
+      }
+    }
+  });
+  double spanSeconds = timeIt([&]() {
+    uint32_t pos = 0;
+    int n;
+    while((n = swapped.copySpan(0, 0, image.width, image.height, pos, buffer.data(), burst)) > 0){
+      sink += buffer[0];
+      pos += n;
+    }
+  });
+  printf("%-16s %4dx%-4d burst %5d | copyRow and swap %7.1f us | copySpan %7.1f us | %5.1f MB/s\n",
+         image.name, image.width, image.height, burst, swapSeconds * 1e6, spanSeconds * 1e6,
+         frame * 2 / spanSeconds / (1024.0 * 1024.0));
+}
+
+//DecodeFileBuffer split across 1 to maxWorkers std::threads, reloading one bitmap so only the decode is timed.
+//each result is checked against the one worker decode, they have to be exactly the same.
+template<typename Bitmap>
+static void parallelBenchmark(TestImage &image, const char *what, int targetWidth, int maxWorkers)
+{
+  std::vector<typename Bitmap::Pixel> serial, row(image.width);
+  double serialSeconds = 0;
+  printf("%-16s %4dx%-4d %-22s |", image.name, image.width, image.height, what);
+  for(int workers = 1; workers <= maxWorkers; workers *= 2){
+    Bitmap bitmap;
+    if(targetWidth > 0)
+      bitmap.setDecodeSize(targetWidth, 0, BITMAP_SCALE_BOX);
+    bitmap.setWorkers(workers);
+    double seconds = timeIt([&]() {
+      checkResult(bitmap.DecodeFileBuffer(image.file.data(), image.file.size()), "DecodeFileBuffer", image);
+    });
+
+    std::vector<typename Bitmap::Pixel> pixels;
+    for(int y = 0; y < bitmap.getHeight(); y++){
+      bitmap.copyRow(y, 0, bitmap.getWidth(), row.data());
+      pixels.insert(pixels.end(), row.begin(), row.begin() + bitmap.getWidth());
+    }
+    if(workers == 1){
+      serial = pixels;
+      serialSeconds = seconds;
+    }
+    bool same = memcmp(serial.data(), pixels.data(), serial.size() * sizeof(serial[0])) == 0 && serial.size() == pixels.size();
+    printf(" %d: %6.2f ms %4.2fx%s |", workers, seconds * 1e3, serialSeconds / seconds, same ? "" : " DIFFERENT");
+    if(!same){
+      fprintf(stderr, "\n%d workers decoded %s %dx%d differently from 1\n", workers, image.name, image.width, image.height);
+      exit(1);
+    }
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+//getFromStream over a link ioRatio times as slow as decoding the image, one thread taking turns against
+//setPipeline's reader and decoder. ideally a pipelined load takes as long as the slower of the two.
+template<typename Bitmap>
+static void pipelineBenchmark(TestImage &image, const char *what, double ioRatio)
+{
+  Bitmap bitmap;
+  double decode = timeIt([&]() {
+    MemoryStream stream(image.file, 1460);
+    checkResult(bitmap.getFromStream(&stream, image.file.size(), streamTimeoutMs), "getFromStream", image);
+  });
+  double io = decode * ioRatio;
+  double rate = image.file.size() / io;
+
+  double serial = timeIt([&]() {
+    ThrottledStream stream(image.file, 1460, rate);
+    checkResult(bitmap.getFromStream(&stream, image.file.size(), streamTimeoutMs), "getFromStream", image);
+  });
+  bitmap.setPipeline(4);
+  double pipelined = timeIt([&]() {
+    ThrottledStream stream(image.file, 1460, rate);
+    checkResult(bitmap.getFromStream(&stream, image.file.size(), streamTimeoutMs), "getFromStream", image);
+  });
+  printf("%-16s %4dx%-4d %-12s | io %6.2f ms decode %6.2f ms | one thread %6.2f ms | pipelined %6.2f ms | max %6.2f ms\n",
+         image.name, image.width, image.height, what, io * 1e3, decode * 1e3, serial * 1e3, pipelined * 1e3,
+         (io > decode ? io : decode) * 1e3);
+  fflush(stdout);
+}
+
+//copyRect of the whole frame from a 1 or 4bpp image, expanding a pixel at a time vs through setExpandTables' table.
+template<typename Bitmap>
+static void expandBenchmark(TestImage &image, const char *what)
+{
+  Bitmap plain, table;
+  plain.setExpandTables(false);
+  checkResult(plain.DecodeFileBuffer(image.file.data(), image.file.size()), "decode", image);
+  checkResult(table.DecodeFileBuffer(image.file.data(), image.file.size()), "decode", image);
+
+  std::vector<typename Bitmap::Pixel> frame((size_t)image.width * image.height);
+  double plainSeconds = timeIt([&]() {
+    plain.copyRect(0, 0, image.width, image.height, frame.data(), image.width);
+    sink += pixelValue(frame[frame.size() - 1]);
+  });
+  double tableSeconds = timeIt([&]() {
+    table.copyRect(0, 0, image.width, image.height, frame.data(), image.width);
+    sink += pixelValue(frame[frame.size() - 1]);
+  });
+  printf("%-16s %4dx%-4d %-12s | per pixel %7.1f us | table %7.1f us | %4.1fx | %5u bytes kept\n",
+         image.name, image.width, image.height, what, plainSeconds * 1e6, tableSeconds * 1e6,
+         plainSeconds / tableSeconds, (unsigned)table.storageCapacity());
+}
+
+//memory kept and decode time with and without setRepack, and a whole frame copyRect from each.
+template<typename Bitmap>
+static void repackBenchmark(TestImage &image, const char *what)
+{
+  Bitmap plain, repacked;
+  repacked.setRepack(true);
+  double plainDecode = timeIt([&]() {
+    checkResult(plain.DecodeFileBuffer(image.file.data(), image.file.size()), "decode", image);
+  });
+  double repackDecode = timeIt([&]() {
+    checkResult(repacked.DecodeFileBuffer(image.file.data(), image.file.size()), "decode", image);
+  });
+
+  std::vector<typename Bitmap::Pixel> frame((size_t)image.width * image.height);
+  double plainCopy = timeIt([&]() {
+    plain.copyRect(0, 0, image.width, image.height, frame.data(), image.width);
+    sink += pixelValue(frame[frame.size() - 1]);
+  });
+  double repackCopy = timeIt([&]() {
+    repacked.copyRect(0, 0, image.width, image.height, frame.data(), image.width);
+    sink += pixelValue(frame[frame.size() - 1]);
+  });
+  printf("%-24s %4dx%-4d %-12s | %6u -> %6u bytes, %2dbpp | decode %7.1f -> %7.1f us | copyRect %7.1f -> %7.1f us\n",
+         image.name, image.width, image.height, what, (unsigned)plain.storageCapacity(), (unsigned)repacked.storageCapacity(),
+         repacked.bitsPerPixel, plainDecode * 1e6, repackDecode * 1e6, plainCopy * 1e6, repackCopy * 1e6);
+}
+
+//memory kept, decode time and the average channel error against the full color image for each setQuantize mode.
+template<typename Format>
+static void quantizeBenchmark(TestImage &image, const char *what)
+{
+  typedef ESPBitmapT<Format> Bitmap;
+  Bitmap full;
+  checkResult(full.DecodeFileBuffer(image.file.data(), image.file.size()), "decode", image);
+  printf("%-24s %4dx%-4d %-12s | full %6u bytes", image.name, image.width, image.height, what, (unsigned)full.storageCapacity());
+  for(BITMAP_QUANTIZE_t mode : { BITMAP_QUANTIZE_332, BITMAP_QUANTIZE_MEDIAN_CUT }){
+    Bitmap quantized;
+    quantized.setQuantize(mode);
+    double seconds = timeIt([&]() {
+      checkResult(quantized.DecodeFileBuffer(image.file.data(), image.file.size()), "decode", image);
+    });
+    double error = 0;
+    for(int y = 0; y < image.height; y++){
+      for(int x = 0; x < image.width; x++){
+        PIXEL_t a = Format::toRGBA(full.getPixel(x, y));
+        PIXEL_t b = Format::toRGBA(quantized.getPixel(x, y));
+        error += abs(a.r - b.r) + abs(a.g - b.g) + abs(a.b - b.b);
+      }
+    }
+    printf(" | %s %6u bytes %6.1f us error %4.1f", mode == BITMAP_QUANTIZE_332 ? "332" : "median cut",
+           (unsigned)quantized.storageCapacity(), seconds * 1e6, error / (3.0 * image.width * image.height));
+  }
+  printf("\n");
+}
+
+//an e-paper frame the way it's done without setDither, the full color image loaded and each pixel thresholded
+//into a packed buffer afterwards, vs loaded straight into a dithered format. shade error is how far the average
+//level of each 8x8 block is from the average luma of the image there, which dithering is meant to keep.
+template<typename Format>
+static void ditherBenchmark(TestImage &image, const char *what)
+{
+  const int levels = (1 << Format::bits) - 1;
+  size_t packedBytes = (image.width * Format::bits + 7) / 8 * image.height;
+  ESPBitmap full;
+  std::vector<uint8_t> packed(packedBytes);
+  double postSeconds = timeIt([&]() {
+    checkResult(full.DecodeFileBuffer(image.file.data(), image.file.size()), "decode", image);
+    memset(packed.data(), 0, packedBytes);
+    for(int y = 0; y < image.height; y++){
+      uint8_t *row = packed.data() + (image.width * Format::bits + 7) / 8 * y;
+      for(int x = 0; x < image.width; x++){
+        PIXEL_t c = full.getPixel(x, y);
+        int bit = x * Format::bits;
+        row[bit >> 3] |= Format::fromRGBA(c.r, c.g, c.b, 0) << (8 - Format::bits - (bit & 7));
+      }
+    }
+  });
+
+  ESPBitmapT<Format> plain, dithered;
+  dithered.setDither(true);
+  checkResult(plain.DecodeFileBuffer(image.file.data(), image.file.size()), "decode", image);
+  double ditherSeconds = timeIt([&]() {
+    checkResult(dithered.DecodeFileBuffer(image.file.data(), image.file.size()), "decode", image);
+  });
+
+  double plainError = 0, ditherError = 0;
+  int blocks = 0;
+  for(int by = 0; by + 8 <= image.height; by += 8){
+    for(int bx = 0; bx + 8 <= image.width; bx += 8, blocks++){
+      double luma = 0, plainLevel = 0, ditherLevel = 0;
+      for(int y = by; y < by + 8; y++){
+        for(int x = bx; x < bx + 8; x++){
+          PIXEL_t c = full.getPixel(x, y);
+          luma += PixelGray8::fromRGBA(c.r, c.g, c.b, 0);
+          plainLevel += plain.getPixel(x, y) * 255.0 / levels;
+          ditherLevel += dithered.getPixel(x, y) * 255.0 / levels;
+        }
+      }
+      plainError += fabs(plainLevel - luma) / 64;
+      ditherError += fabs(ditherLevel - luma) / 64;
+    }
+  }
+  printf("%-16s %4dx%-4d %-14s | full + threshold %6u bytes %7.1f us | dithered %6u bytes %7.1f us | shade error %5.1f -> %4.1f\n",
+         image.name, image.width, image.height, what, (unsigned)(full.storageCapacity() + packedBytes), postSeconds * 1e6,
+         (unsigned)dithered.storageCapacity(), ditherSeconds * 1e6, plainError / blocks, ditherError / blocks);
+}
+
+//an icon overlaid on a 565 framebuffer a pixel at a time from getPixel, the way it's done without blendOnto,
+//vs blendOnto of the same icon loaded premultiplied into an ESPBitmap16.
+static void blendBenchmark(TestImage &image)
+{
+  const int frameWidth = 240, frameHeight = 240;
+  std::vector<uint16_t> frame(frameWidth * frameHeight, 0x39E7);
+  ESPBitmap straight;
+  straight.setPremultipliedAlpha(true);
+  checkResult(straight.DecodeFileBuffer(image.file.data(), image.file.size()), "decode", image);
+  ESPBitmap16 icon;
+  icon.setPremultipliedAlpha(true);
+  checkResult(icon.DecodeFileBuffer(image.file.data(), image.file.size()), "decode", image);
+
+  int x = (frameWidth - image.width) / 2, y = (frameHeight - image.height) / 2;
+  double pixelSeconds = timeIt([&]() {
+    for(int row = 0; row < image.height; row++){
+      uint16_t *dst = frame.data() + (y + row) * frameWidth + x;
+      for(int column = 0; column < image.width; column++){
+        PIXEL_t c = straight.getPixel(column, row);
+        PIXEL_t under = PixelRGB565::toRGBA(dst[column]);
+        dst[column] = ESPBitmap16::Color(c.r + under.r * (255 - c.a) / 255, c.g + under.g * (255 - c.a) / 255,
+                                         c.b + under.b * (255 - c.a) / 255);
+      }
+    }
+    sink += frame[y * frameWidth + x];
+  });
+  int shown = 0;
+  double blendSeconds = timeIt([&]() {
+    shown = icon.blendOnto(frame.data(), frameWidth, x, y, frameWidth, frameHeight);
+    sink += frame[y * frameWidth + x];
+  });
+  printf("%-18s %4dx%-4d | %5d pixels, %5d shown | getPixel and blend %7.1f us | blendOnto %7.1f us | %5.1fx | %5u bytes kept\n",
+         image.name, image.width, image.height, image.width * image.height, shown, pixelSeconds * 1e6, blendSeconds * 1e6,
+         pixelSeconds / blendSeconds, (unsigned)icon.storageCapacity());
+}
+
+static double megabytesPerSecond(const TestImage &image, double seconds)
+{
+  return image.file.size() / seconds / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+  bool quick = false;
+  bool stats = false;
+  bool timeGiven = false;
+  for(int i = 1; i < argc; i++){
+    if(strcmp(argv[i], "--quick") == 0)
+      quick = true;
+    else if(strcmp(argv[i], "--stats") == 0)
+      stats = true;
+    else{
+      minimumSeconds = atof(argv[i]) / 1000.0;
+      timeGiven = true;
+    }
+  }
+  if(quick && !timeGiven)
+    minimumSeconds = 0.02;
+
+  static const uint32_t masks565[] = { 0xF800, 0x07E0, 0x001F };
+  static const uint32_t masksRGBA[] = { 0x000000FF, 0x0000FF00, 0x00FF0000 };
+  struct Format { const char *name; int bitsPerPixel; int compression; const uint32_t *masks; };
+  static const Format formats[] = {
+    { "1bpp",            1,  BI_UNCOMPRESSED, 0 },
+    { "4bpp",            4,  BI_UNCOMPRESSED, 0 },
+    { "8bpp",            8,  BI_UNCOMPRESSED, 0 },
+    { "4bpp RLE",        4,  BI_RLE_4,        0 },
+    { "8bpp RLE",        8,  BI_RLE_8,        0 },
+    { "16bpp 555",       16, BI_UNCOMPRESSED, 0 },
+    { "16bpp 565",       16, BI_BITFIELDS,    masks565 },
+    { "24bpp",           24, BI_UNCOMPRESSED, 0 },
+    { "32bpp",           32, BI_UNCOMPRESSED, 0 },
+    { "32bpp RGBA mask", 32, BI_BITFIELDS,    masksRGBA },
+  };
+  struct Size { int width; int height; };
+  static const Size sizes[] = { { 64, 64 }, { 320, 240 }, { 800, 600 } };
+
+  printf("decode and getFromStream in MB/s of file, getPixel in ns per pixel, heap in KB.\n");
+  printf("getFromStream and StreamDecode read from a stream handing out 1460 byte chunks (64 byte for the s64 column).\n");
+  printf("sSlow is getFromStream from a stream that takes 1us per call, like a WiFiClient.\n\n");
+  printf("%-16s %-8s %8s | %8s %8s | %7s %7s | %8s %8s %8s %8s | %8s %8s | %7s %7s %7s\n",
+         "format", "size", "file KB",
+         "decode", "dec16", "getPx", "getPx16",
+         "stream", "s64", "sSlow", "stream16", "sdecode", "sdec16",
+         "heapDec", "heapStr", "heapSD");
+
+  for(const Size &size : sizes){
+    if(quick && size.width != 320)
+      continue;
+    for(const Format &format : formats){
+      TestImage image = makeImage(format.name, size.width, size.height, format.bitsPerPixel, format.compression, format.masks);
+      size_t decodeHeap, decode16Heap, streamHeap, stream64Heap, streamSlowHeap, stream16Heap, streamDecodeHeap;
+
+      double decode = decodeSeconds<ESPBitmap>(image, decodeHeap);
+      double decode16 = decodeSeconds<ESPBitmap16>(image, decode16Heap);
+      double pixel = getPixelNanoseconds<ESPBitmap>(image);
+      double pixel16 = getPixelNanoseconds<ESPBitmap16>(image);
+      double stream = getFromStreamSeconds<ESPBitmap>(image, 1460, streamHeap);
+      double stream64 = getFromStreamSeconds<ESPBitmap>(image, 64, stream64Heap);
+      double streamSlow = getFromStreamSeconds<ESPBitmap>(image, 1460, streamSlowHeap, 1e-6);
+      double stream16 = getFromStreamSeconds<ESPBitmap16>(image, 1460, stream16Heap);
+      double streamDecode = streamDecodeSeconds(image, 1460, streamDecodeHeap);
+      double streamDecode16 = streamDecode16Seconds(image, 1460);
+
+      char dimensions[16];
+      snprintf(dimensions, sizeof(dimensions), "%dx%d", size.width, size.height);
+      printf("%-16s %-8s %8.1f | %8.1f %8.1f | %7.2f %7.2f | %8.1f %8.1f %8.1f %8.1f | %8.1f %8.1f | %7.1f %7.1f %7.1f\n",
+             format.name, dimensions, image.file.size() / 1024.0,
+             megabytesPerSecond(image, decode), megabytesPerSecond(image, decode16),
+             pixel, pixel16,
+             megabytesPerSecond(image, stream), megabytesPerSecond(image, stream64), megabytesPerSecond(image, streamSlow),
+             megabytesPerSecond(image, stream16),
+             megabytesPerSecond(image, streamDecode), megabytesPerSecond(image, streamDecode16),
+             decodeHeap / 1024.0, streamHeap / 1024.0, streamDecodeHeap / 1024.0);
+      fflush(stdout);
+    }
+  }
+
+  printf("\nESPBitmapFile, pixel data read from a temporary file through the scanline cache.\n");
+  {
+    TestImage map = quick ? makeImage("24bpp", 800, 600, 24, BI_UNCOMPRESSED, 0)
+                          : makeImage("24bpp", 2000, 2000, 24, BI_UNCOMPRESSED, 0);
+    for(int cacheRows : { 4, 16, 256 })
+      fileBenchmark(map, cacheRows);
+  }
+
+  printf("\nloading a slideshow of 6 images into ESPBitmap16 over and over, and how a 64KB heap holds up.\n");
+  {
+    std::vector<TestImage> slides;
+    slides.push_back(makeImage("24bpp", 160, 120, 24, BI_UNCOMPRESSED, 0));
+    slides.push_back(makeImage("8bpp", 200, 150, 8, BI_UNCOMPRESSED, 0));
+    slides.push_back(makeImage("4bpp RLE", 120, 90, 4, BI_RLE_4, 0));
+    slides.push_back(makeImage("16bpp 565", 180, 100, 16, BI_BITFIELDS, masks565));
+    slides.push_back(makeImage("24bpp", 96, 96, 24, BI_UNCOMPRESSED, 0));
+    slides.push_back(makeImage("1bpp", 240, 240, 1, BI_UNCOMPRESSED, 0));
+    int loads = quick ? 60 : 600;
+    reloadBenchmark(slides, false, false, loads);
+    reloadBenchmark(slides, true, false, loads);
+    reloadBenchmark(slides, true, true, loads);
+  }
+
+  printf("\nESPBitmapCache, a dashboard drawing 8 of 12 icons per refresh, loaded over a stream at 1us per call.\n");
+  {
+    IconSet set;
+    for(int i = 0; i < 12; i++)
+      set.icons.push_back(i % 3 == 0 ? makeImage("8bpp", 64, 64, 8, BI_UNCOMPRESSED, 0)
+                                     : makeImage("24bpp", 48, 48, 24, BI_UNCOMPRESSED, 0));
+    for(size_t budget : { (size_t)0, (size_t)8 * 1024, (size_t)24 * 1024, (size_t)64 * 1024 })
+      cacheBenchmark(set, budget);
+  }
+
+  printf("\nfetchImageFromUrl of 8 images per refresh from an in process stand-in server with ETags.\n");
+  {
+    StandInServer server;
+    for(int i = 0; i < 8; i++){
+      server.images.push_back(makeImage("24bpp", 64, 64, 24, BI_UNCOMPRESSED, 0));
+      server.versions.push_back(0);
+    }
+    for(int changedPercent : { 10, 100 }){
+      conditionalFetchBenchmark(server, false, changedPercent);
+      conditionalFetchBenchmark(server, true, changedPercent);
+    }
+  }
+
+  printf("\npushing a 240x240 frame to an SPI panel in writePixels bursts, swapping ESPBitmap16 rows vs ESPBitmap16Swapped.\n");
+  {
+    TestImage photo = makeImage("24bpp", 240, 240, 24, BI_UNCOMPRESSED, 0);
+    TestImage paletted = makeImage("8bpp", 240, 240, 8, BI_UNCOMPRESSED, 0);
+    for(int burst : { 64, 512, 4096 }){
+      panelBenchmark(photo, burst);
+      panelBenchmark(paletted, burst);
+    }
+  }
+
+  int maxWorkers = std::thread::hardware_concurrency();
+  if(maxWorkers < 4)
+    maxWorkers = 4;
+  printf("\nDecodeFileBuffer split across 1 to %d threads with setWorkers, time and speedup over 1.\n", maxWorkers);
+  {
+    TestImage photo = quick ? makeImage("24bpp", 800, 600, 24, BI_UNCOMPRESSED, 0)
+                            : makeImage("24bpp", 1600, 1200, 24, BI_UNCOMPRESSED, 0);
+    TestImage masked = quick ? makeImage("32bpp RGBA mask", 800, 600, 32, BI_BITFIELDS, masksRGBA)
+                             : makeImage("32bpp RGBA mask", 1600, 1200, 32, BI_BITFIELDS, masksRGBA);
+    parallelBenchmark<ESPBitmap16>(photo, "ESPBitmap16", 0, maxWorkers);
+    parallelBenchmark<ESPBitmapGray>(photo, "ESPBitmapGray", 0, maxWorkers);
+    parallelBenchmark<ESPBitmap16>(masked, "ESPBitmap16", 0, maxWorkers);
+    parallelBenchmark<ESPBitmap16>(photo, "ESPBitmap16 box 1/4", photo.width / 4, maxWorkers);
+    parallelBenchmark<ESPBitmap>(photo, "ESPBitmap box 1/2", photo.width / 2, maxWorkers);
+  }
+
+  printf("\ngetFromStream over a throttled link, taking turns on one thread vs setPipeline(4) with a reader thread.\n");
+  {
+    TestImage photo = quick ? makeImage("24bpp", 800, 600, 24, BI_UNCOMPRESSED, 0)
+                            : makeImage("24bpp", 1600, 1200, 24, BI_UNCOMPRESSED, 0);
+    for(double ioRatio : { 0.5, 1.0, 2.0 }){
+      pipelineBenchmark<ESPBitmap16>(photo, "ESPBitmap16", ioRatio);
+      pipelineBenchmark<ESPBitmapGray>(photo, "ESPBitmapGray", ioRatio);
+    }
+  }
+
+  printf("\ncopyRect of whole 1 and 4bpp frames, with and without setExpandTables.\n");
+  {
+    TestImage images[] = {
+      makeImage("1bpp", 240, 240, 1, BI_UNCOMPRESSED, 0),
+      makeImage("4bpp", 240, 240, 4, BI_UNCOMPRESSED, 0),
+      makeImage("4bpp", 48, 48, 4, BI_UNCOMPRESSED, 0),
+    };
+    for(TestImage &image : images){
+      expandBenchmark<ESPBitmap16>(image, "ESPBitmap16");
+      expandBenchmark<ESPBitmap>(image, "ESPBitmap");
+    }
+  }
+
+  printf("\nimages of few colors kept as they are vs repacked into the fewest bits per pixel by setRepack.\n");
+  {
+    TestImage images[] = {
+      withColors(makeImage("8bpp", 240, 240, 8, BI_UNCOMPRESSED, 0), 16),
+      withColors(makeImage("24bpp", 240, 240, 24, BI_UNCOMPRESSED, 0), 3),
+      withColors(makeImage("24bpp", 240, 240, 24, BI_UNCOMPRESSED, 0), 12),
+      withColors(makeImage("24bpp", 240, 240, 24, BI_UNCOMPRESSED, 0), 200),
+      makeImage("24bpp photo", 240, 240, 24, BI_UNCOMPRESSED, 0),
+    };
+    for(TestImage &image : images){
+      repackBenchmark<ESPBitmap16>(image, "ESPBitmap16");
+      repackBenchmark<ESPBitmap>(image, "ESPBitmap");
+    }
+  }
+
+  printf("\n24bpp images kept in full color vs quantized to 8bpp by setQuantize, average error per channel.\n");
+  {
+    TestImage images[] = {
+      withGradient(makeImage("24bpp", 320, 240, 24, BI_UNCOMPRESSED, 0)),
+      makeImage("24bpp noise", 320, 240, 24, BI_UNCOMPRESSED, 0),
+    };
+    for(TestImage &image : images){
+      quantizeBenchmark<PixelRGB565>(image, "ESPBitmap16");
+      quantizeBenchmark<PixelRGB888>(image, "ESPBitmap");
+    }
+  }
+
+  printf("\ne-paper frames loaded in full color and thresholded afterwards vs loaded into a format with setDither.\n");
+  {
+    TestImage images[] = {
+      withGradient(makeImage("24bpp", 296, 128, 24, BI_UNCOMPRESSED, 0)),
+      makeImage("24bpp photo", 296, 128, 24, BI_UNCOMPRESSED, 0),
+      makeImage("8bpp", 296, 128, 8, BI_UNCOMPRESSED, 0),
+    };
+    for(TestImage &image : images){
+      ditherBenchmark<PixelMono1>(image, "ESPBitmapMono");
+      ditherBenchmark<PixelGray2>(image, "ESPBitmapGray2");
+      ditherBenchmark<PixelGray4>(image, "ESPBitmapGray4");
+    }
+  }
+
+  printf("\n32bpp icons with alpha drawn onto an RGB565 frame, a pixel at a time vs blendOnto of a premultiplied ESPBitmap16.\n");
+  {
+    TestImage images[] = {
+      withAlpha(makeImage("32bpp", 64, 64, 32, BI_UNCOMPRESSED, 0), false),
+      withAlpha(makeImage("32bpp", 64, 64, 32, BI_UNCOMPRESSED, 0), true),
+      withAlpha(makeImage("32bpp", 160, 160, 32, BI_UNCOMPRESSED, 0), true),
+    };
+    for(TestImage &image : images)
+      blendBenchmark(image);
+  }
+
+  if(stats){
+#ifdef ESPBITMAP_STATS
+    printf("\nstats of a getFromStream load, 1460 byte chunks at 1us per stream call.\n");
+    for(const Size &size : sizes){
+      if(quick && size.width != 320)
+        continue;
+      for(const Format &format : formats)
+        printStats(makeImage(format.name, size.width, size.height, format.bitsPerPixel, format.compression, format.masks));
+    }
+#else
+    printf("\n--stats needs the library built with ESPBITMAP_STATS.\n");
+#endif
+  }
+  return 0;
+}
@@ -0,0 +1,1750 @@
+/*
+ESPBitmap Library
+Copyright 2018 Rickey Ward
+
+MIT License
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom
+the Software is furnished to do so, subject to the following conditions: The
+above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED "AS
+IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+//host tests of the decoders, run by ctest (one test per name below) or by hand:
+//  ./espbitmap_tests            runs them all
+//  ./espbitmap_tests name...    runs the ones named
+//a failed CHECK prints where it was and the run exits non-zero.
+
+#include <Arduino.h>
+#include <ESPBitmap.h>
+#include <ESPBitmap16.h>
+#include <ESPBitmapFile.h>
+#include <ESPBitmapCache.h>
+#include <ESPBitmapTransport.h>
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    if(!(condition)){ \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      failures++; \
+    } \
+  } while(0)
+
+//------------------------------------------------------------------ test bitmaps
+
+static void put16(std::vector<uint8_t> &v, size_t offset, uint16_t value)
+{
+  v[offset] = value;
+  v[offset + 1] = value >> 8;
+}
+
+static void put32(std::vector<uint8_t> &v, size_t offset, uint32_t value)
+{
+  for(int i = 0; i < 4; i++)
+    v[offset + i] = value >> (8 * i);
+}
+
+static uint32_t randomState = 1;
+
+static uint8_t randomByte()
+{
+  randomState = randomState * 1103515245 + 12345;
+  return randomState >> 16;
+}
+
+//a bitmap file with an info header of headerSize bytes (40, or 108 for V4 with masks in it), then
+//colors random palette entries and pixels as given (already padded rows, or RLE data).
+//height < 0 makes a top down image. masks, when given, are red, green, blue and alpha.
+static std::vector<uint8_t> makeFile(int width, int height, int bitsPerPixel, int compression, int headerSize,
+                                     const uint32_t *masks, int colors, const std::vector<uint8_t> &pixels)
+{
+  size_t maskBytes = (masks != 0 && headerSize == 40) ? 12 : 0;
+  size_t dataOffset = 14 + headerSize + maskBytes + colors * 4;
+  std::vector<uint8_t> file(dataOffset, 0);
+  file[0] = 'B';
+  file[1] = 'M';
+  put32(file, 10, dataOffset);
+  put32(file, 14, headerSize);
+  put32(file, 18, width);
+  put32(file, 22, height);
+  put16(file, 26, 1);
+  put16(file, 28, bitsPerPixel);
+  put32(file, 30, compression);
+  put32(file, 34, pixels.size());
+  if(masks != 0){
+    for(int i = 0; i < (headerSize == 40 ? 3 : 4); i++)
+      put32(file, 54 + 4 * i, masks[i]);
+  }
+  for(int i = 0; i < colors * 4; i++)
+    file[14 + headerSize + maskBytes + i] = (i % 4 == 3) ? 0 : randomByte();
+  file.insert(file.end(), pixels.begin(), pixels.end());
+  put32(file, 2, file.size());
+  return file;
+}
+
+//an uncompressed image of random pixels.
+static std::vector<uint8_t> randomFile(int width, int height, int bitsPerPixel)
+{
+  size_t scanlineWidth = 4 * ((width * bitsPerPixel + 31) / 32);
+  std::vector<uint8_t> pixels(scanlineWidth * (height < 0 ? -height : height));
+  for(uint8_t &byte : pixels)
+    byte = randomByte();
+  return makeFile(width, height, bitsPerPixel, BI_UNCOMPRESSED, 40, 0, bitsPerPixel <= 8 ? 1 << bitsPerPixel : 0, pixels);
+}
+
+//hands out a file a few bytes at a time, like packets arriving.
+class MemoryStream : public Stream
+{
+  public:
+    MemoryStream(const std::vector<uint8_t> &file, size_t chunkSize) : data(file), chunk(chunkSize) {}
+
+    int available() { size_t left = data.size() - position; return (int)(left > chunk ? chunk : left); }
+    int read() { return position < data.size() ? data[position++] : -1; }
+    int peek() { return position < data.size() ? data[position] : -1; }
+    size_t readBytes(char *buffer, size_t count)
+    {
+      if(count > (size_t)available())
+        count = available();
+      memcpy(buffer, data.data() + position, count);
+      position += count;
+      return count;
+    }
+
+  private:
+    const std::vector<uint8_t> &data;
+    size_t position = 0;
+    size_t chunk;
+};
+
+static bool samePixel(PIXEL_t a, PIXEL_t b) { return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a; }
+
+//------------------------------------------------------------------ StreamDecode
+
+static ESPBitmap *streamReference;
+static int streamRows;
+static int streamLastY;
+static bool streamRowsMatch;
+static bool streamInOrder;
+
+static void streamRow(int y, PIXEL_t *pixels, int width)
+{
+  streamRows++;
+  if(streamLastY >= 0 && y != streamLastY + (streamReference->flipped ? 1 : -1))
+    streamInOrder = false;
+  streamLastY = y;
+  for(int x = 0; x < width; x++)
+    if(!samePixel(pixels[x], streamReference->getPixel(x, y)))
+      streamRowsMatch = false;
+}
+
+//every row reaches the callback once, in file order, with the pixels DecodeFileBuffer gives,
+//and the decode never holds more than the palette and a couple of scanlines.
+static void testStreamDecode()
+{
+  const int depths[] = { 1, 4, 8, 16, 24, 32 };
+  for(int bitsPerPixel : depths){
+    for(int height : { 21, -21 }){
+      std::vector<uint8_t> file = randomFile(37, height, bitsPerPixel);
+      ESPBitmap reference;
+      CHECK(reference.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+
+      ESPBitmap bitmap;
+      MemoryStream stream(file, 7);
+      streamReference = &reference;
+      streamRows = 0;
+      streamLastY = -1;
+      streamRowsMatch = true;
+      streamInOrder = true;
+      CHECK(bitmap.StreamDecode(&stream, file.size(), 1000, streamRow) == BITMAP_SUCCESS);
+      CHECK(streamRows == 21);
+      CHECK(streamRowsMatch);
+      CHECK(streamInOrder);
+#ifdef ESPBITMAP_STATS
+      size_t scanlineWidth = 4 * ((37 * bitsPerPixel + 31) / 32);
+      size_t paletteBytes = bitsPerPixel <= 8 ? (1 << bitsPerPixel) * sizeof(PIXEL_t) : 0;
+      CHECK(bitmap.stats.peakBytes <= paletteBytes + scanlineWidth + 37 * sizeof(PIXEL_t) + 64);
+#endif
+    }
+  }
+}
+
+//------------------------------------------------------------------ ESPBitmapFile
+
+//writes file to a temporary file on disk, read back through an ESPBitmapStdioSource.
+static FILE *diskFile(const std::vector<uint8_t> &file)
+{
+  FILE *disk = tmpfile();
+  if(disk != 0)
+    fwrite(file.data(), 1, file.size(), disk);
+  return disk;
+}
+
+//rows read from a real file match DecodeFileBuffer's, and the row cache hits, misses and evicts the least
+//recently used row the way its counters say.
+static void testFileSource()
+{
+  for(int bitsPerPixel : { 1, 4, 8, 16, 24, 32 }){
+    std::vector<uint8_t> file = randomFile(301, 203, bitsPerPixel);
+    ESPBitmap reference;
+    CHECK(reference.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+    FILE *disk = diskFile(file);
+    CHECK(disk != 0);
+    if(disk == 0)
+      return;
+    ESPBitmapStdioSource source(disk);
+    ESPBitmapFile bitmap;
+    bitmap.setCacheRows(2);
+    CHECK(bitmap.open(&source) == BITMAP_SUCCESS);
+    CHECK(bitmap.width == 301 && bitmap.height == 203);
+    //just the palette, two cached rows and the row table are kept, not the image.
+    size_t scanlineWidth = 4 * ((301 * bitsPerPixel + 31) / 32);
+    CHECK(bitmap.storageCapacity() < 4096 + 2 * scanlineWidth + 203 * 2 + 64);
+
+    //row 0 is read, then found. row 2 pushes out row 0, the older of the two.
+    std::vector<PIXEL_t> row(301), expected(301);
+    CHECK(bitmap.copyRow(0, 0, 301, row.data()) == 301);
+    CHECK(bitmap.cacheMisses == 1 && bitmap.cacheHits == 0);
+    CHECK(samePixel(bitmap.getPixel(5, 0), reference.getPixel(5, 0)));
+    CHECK(bitmap.cacheMisses == 1 && bitmap.cacheHits == 1);
+    bitmap.copyRow(1, 0, 301, row.data());
+    bitmap.copyRow(2, 0, 301, row.data());
+    bitmap.copyRow(1, 0, 301, row.data());
+    CHECK(bitmap.cacheMisses == 3 && bitmap.cacheHits == 2);
+    bitmap.copyRow(0, 0, 301, row.data());
+    CHECK(bitmap.cacheMisses == 4 && bitmap.cacheHits == 2);
+
+    //every row, in an order that keeps missing.
+    bool same = true;
+    for(int i = 0; i < 203; i++){
+      int y = (i * 67) % 203;
+      bitmap.copyRow(y, 0, 301, row.data());
+      reference.copyRow(y, 0, 301, expected.data());
+      for(int x = 0; x < 301; x++)
+        if(!samePixel(row[x], expected[x]))
+          same = false;
+    }
+    CHECK(same);
+    fclose(disk);
+  }
+
+  //RLE rows can't be found without decoding everything before them.
+  std::vector<uint8_t> rle = makeFile(4, 1, 8, BI_RLE_8, 40, 0, 256, std::vector<uint8_t>({ 4, 7, 0, 0, 0, 1 }));
+  FILE *disk = diskFile(rle);
+  ESPBitmapStdioSource source(disk);
+  ESPBitmapFile bitmap;
+  CHECK(bitmap.open(&source) == BITMAP_ERROR_UNSUPPORTED_COMPRESSION);
+  fclose(disk);
+}
+
+//------------------------------------------------------------------ ESPBitmapCache
+
+//stands in for a server or an SD card, icons "0", "1"... decoded from memory, counting the loads.
+struct IconSource {
+  std::vector<std::vector<uint8_t> > files;
+  int loads = 0;
+};
+
+static BITMAP_RESULT_t loadIcon(const char *key, ESPBitmap16 &bitmap, void *context)
+{
+  IconSource &icons = *(IconSource *)context;
+  size_t index = atoi(key);
+  if(index >= icons.files.size())
+    return BITMAP_ERROR_FETCH_FAILED;
+  icons.loads++;
+  return bitmap.DecodeFileBuffer(icons.files[index].data(), icons.files[index].size());
+}
+
+//hits don't load, the budget is kept by dropping the least recently used bitmap, and failed loads aren't kept.
+static void testCache()
+{
+  IconSource icons;
+  for(int i = 0; i < 3; i++)
+    icons.files.push_back(randomFile(32, 32, 24));
+  ESPBitmap16 probe;
+  probe.DecodeFileBuffer(icons.files[0].data(), icons.files[0].size());
+  size_t iconBytes = probe.storageCapacity();
+
+  //room for two of them.
+  ESPBitmapCache<ESPBitmap16> cache(iconBytes * 2 + iconBytes / 2);
+  ESPBitmap16 *first = 0, *again = 0, *bitmap = 0;
+  CHECK(cache.get("0", first, loadIcon, &icons) == BITMAP_SUCCESS);
+  CHECK(cache.get("0", again, loadIcon, &icons) == BITMAP_SUCCESS);
+  CHECK(first == again && icons.loads == 1);
+  CHECK(cache.hits == 1 && cache.misses == 1);
+  CHECK(first->getPixel(3, 4) == probe.getPixel(3, 4));
+
+  //1 is loaded, 0 is used again, so 2 pushes out 1.
+  CHECK(cache.get("1", bitmap, loadIcon, &icons) == BITMAP_SUCCESS);
+  CHECK(cache.get("0", bitmap, loadIcon, &icons) == BITMAP_SUCCESS);
+  CHECK(cache.get("2", bitmap, loadIcon, &icons) == BITMAP_SUCCESS);
+  CHECK(icons.loads == 3 && cache.evictions == 1);
+  CHECK(cache.entryCount() == 2 && cache.bytesUsed() == 2 * iconBytes);
+  CHECK(cache.bytesUsed() <= cache.budgetBytes());
+  CHECK(cache.get("0", bitmap, loadIcon, &icons) == BITMAP_SUCCESS);
+  CHECK(icons.loads == 3);
+  CHECK(cache.get("1", bitmap, loadIcon, &icons) == BITMAP_SUCCESS);
+  CHECK(icons.loads == 4 && cache.evictions == 2);
+
+  //a failed load leaves nothing behind and is tried again next time.
+  CHECK(cache.get("7", bitmap, loadIcon, &icons) == BITMAP_ERROR_FETCH_FAILED);
+  CHECK(bitmap == 0 && cache.entryCount() == 2);
+  uint32_t misses = cache.misses;
+  CHECK(cache.get("7", bitmap, loadIcon, &icons) == BITMAP_ERROR_FETCH_FAILED);
+  CHECK(cache.misses == misses + 1);
+
+  CHECK(cache.remove("1"));
+  CHECK(!cache.remove("1"));
+  CHECK(cache.entryCount() == 1 && cache.bytesUsed() == iconBytes);
+  cache.setBudget(iconBytes / 2);
+  CHECK(cache.entryCount() == 0 && cache.bytesUsed() == 0);
+
+  //one bigger than the whole budget is still handed out, and goes first.
+  CHECK(cache.get("0", bitmap, loadIcon, &icons) == BITMAP_SUCCESS);
+  CHECK(bitmap != 0 && cache.entryCount() == 1);
+  CHECK(cache.get("2", bitmap, loadIcon, &icons) == BITMAP_SUCCESS);
+  CHECK(cache.entryCount() == 1);
+  CHECK(cache.get("2", bitmap, loadIcon, &icons) == BITMAP_SUCCESS);
+  CHECK(cache.hits == 4);
+}
+
+//------------------------------------------------------------------ conditional fetches
+
+//an in process stand-in for a web server holding one image per url ("/0", "/1"...), answering conditional
+//requests like a real one. it sends an ETag, a Last-Modified, or both, and remembers what it was asked.
+class StandInServer : public ESPBitmapTransport
+{
+  public:
+    std::vector<std::vector<uint8_t> > files;
+    std::vector<int> versions;
+    bool sendETag = true;
+    bool sendLastModified = true;
+    int requests = 0;
+    int notModified = 0;
+    size_t bytesSent = 0;
+    String askedETag;
+    String askedLastModified;
+
+    int get(const String &url, const String &ifNoneMatch, const String &ifModifiedSince)
+    {
+      requests++;
+      current = atoi(url.c_str() + 1);
+      askedETag = ifNoneMatch;
+      askedLastModified = ifModifiedSince;
+      if((ifNoneMatch.length() > 0 && ifNoneMatch == currentETag())
+         || (ifModifiedSince.length() > 0 && ifModifiedSince == currentLastModified())){
+        notModified++;
+        return HTTP_CODE_NOT_MODIFIED;
+      }
+      body = new MemoryStream(files[current], 1460);
+      bytesSent += files[current].size();
+      return HTTP_CODE_OK;
+    }
+    Stream *stream() { return body; }
+    int size() { return files[current].size(); }
+    String etag() { return sendETag ? currentETag() : String(); }
+    String lastModified() { return sendLastModified ? currentLastModified() : String(); }
+    void end() { delete body; body = 0; }
+
+  private:
+    String currentETag() { return String("\"") + String(versions[current]) + "\""; }
+    String currentLastModified() { return String("Sun, 0") + String(versions[current] % 10) + " Jan 2017 00:00:00 GMT"; }
+    int current = 0;
+    MemoryStream *body = 0;
+};
+
+//fetches one url twice, then again after it changed. returns false if any fetch failed.
+static bool fetchThreeTimes(StandInServer &server, ESPBitmap16 &bitmap, bool &secondNotModified, bool &thirdNotModified)
+{
+  bool fetched = bitmap.fetchImageFromUrl("/0") == BITMAP_SUCCESS;
+  fetched = bitmap.fetchImageFromUrl("/0") == BITMAP_SUCCESS && fetched;
+  secondNotModified = bitmap.fetchNotModified;
+  server.versions[0]++;
+  server.files[0] = randomFile(24, 24, 24);
+  fetched = bitmap.fetchImageFromUrl("/0") == BITMAP_SUCCESS && fetched;
+  thirdNotModified = bitmap.fetchNotModified;
+  return fetched;
+}
+
+//refetching an unchanged image is a 304 that keeps the image without sending or decoding it, whether the server
+//gave an ETag, only a Last-Modified, or both. a changed image, or another url, is sent again.
+static void testConditionalFetch()
+{
+  for(int validators = 0; validators < 3; validators++){
+    StandInServer server;
+    server.files.push_back(randomFile(24, 24, 24));
+    server.files.push_back(randomFile(24, 24, 24));
+    server.versions.assign(2, 1);
+    server.sendETag = validators != 1;
+    server.sendLastModified = validators != 0;
+
+    ESPBitmap16 bitmap;
+    bitmap.setTransport(&server);
+    CHECK(bitmap.fetchImageFromUrl("/0") == BITMAP_SUCCESS);
+    CHECK(!bitmap.fetchNotModified);
+    CHECK(server.askedETag.length() == 0 && server.askedLastModified.length() == 0);
+    uint16_t before = bitmap.getPixel(5, 6);
+    size_t sent = server.bytesSent;
+
+    //the second fetch asks with exactly the validators the first response had.
+    CHECK(bitmap.fetchImageFromUrl("/0") == BITMAP_SUCCESS);
+    CHECK(bitmap.fetchNotModified);
+    CHECK(server.notModified == 1 && server.bytesSent == sent);
+    CHECK((server.askedETag.length() > 0) == server.sendETag);
+    CHECK((server.askedLastModified.length() > 0) == server.sendLastModified);
+    CHECK(bitmap.getPixel(5, 6) == before && bitmap.width == 24);
+
+    //another url isn't conditional.
+    CHECK(bitmap.fetchImageFromUrl("/1") == BITMAP_SUCCESS);
+    CHECK(!bitmap.fetchNotModified);
+    CHECK(server.askedETag.length() == 0 && server.askedLastModified.length() == 0);
+
+    bool secondNotModified, thirdNotModified;
+    CHECK(fetchThreeTimes(server, bitmap, secondNotModified, thirdNotModified));
+    CHECK(secondNotModified && !thirdNotModified);
+    ESPBitmap16 changed;
+    changed.DecodeFileBuffer(server.files[0].data(), server.files[0].size());
+    bool same = true;
+    for(int y = 0; y < 24; y++)
+      for(int x = 0; x < 24; x++)
+        if(bitmap.getPixel(x, y) != changed.getPixel(x, y))
+          same = false;
+    CHECK(same);
+  }
+}
+
+//------------------------------------------------------------------ packed formats
+
+//pixels of a packed bitmap match ESPBitmap's converted to its format, however they were loaded.
+template<class Format>
+static bool sameAsColor(ESPBitmapT<Format> &bitmap, ESPBitmap &color)
+{
+  if(bitmap.getWidth() != color.getWidth() || bitmap.getHeight() != color.getHeight())
+    return false;
+  for(int y = 0; y < color.getHeight(); y++){
+    for(int x = 0; x < color.getWidth(); x++){
+      PIXEL_t c = color.getPixel(x, y);
+      if(bitmap.getPixel(x, y) != Format::fromRGBA(c.r, c.g, c.b, 0))
+        return false;
+    }
+  }
+  return true;
+}
+
+//a paletted image of more bits than the format is packed without setDither, from a buffer, a stream or reduced.
+template<class Format>
+static void checkPackedPalette(const std::vector<uint8_t> &file, int bitsPerPixel)
+{
+  ESPBitmap color;
+  CHECK(color.DecodeFileBuffer((uint8_t *)file.data(), file.size()) == BITMAP_SUCCESS);
+  ESPBitmapT<Format> buffered;
+  CHECK(buffered.DecodeFileBuffer((uint8_t *)file.data(), file.size()) == BITMAP_SUCCESS);
+  CHECK(sameAsColor(buffered, color));
+  size_t packedBytes = (color.getWidth() * Format::bits + 7) / 8 * color.getHeight();
+  size_t paletteBytes = (1 << bitsPerPixel) * 4;
+  CHECK(buffered.storageCapacity() <= packedBytes + paletteBytes + 1024);
+
+  ESPBitmapT<Format> streamed;
+  MemoryStream stream(file, 7);
+  CHECK(streamed.getFromStream(&stream, file.size(), 1000) == BITMAP_SUCCESS);
+  CHECK(sameAsColor(streamed, color));
+  CHECK(streamed.storageCapacity() <= packedBytes + paletteBytes + 1024);
+
+  ESPBitmap colorReduced;
+  colorReduced.setDecodeSize(97, 0);
+  CHECK(colorReduced.DecodeFileBuffer((uint8_t *)file.data(), file.size()) == BITMAP_SUCCESS);
+  ESPBitmapT<Format> reduced;
+  reduced.setDecodeSize(97, 0);
+  CHECK(reduced.DecodeFileBuffer((uint8_t *)file.data(), file.size()) == BITMAP_SUCCESS);
+  CHECK(sameAsColor(reduced, colorReduced));
+}
+
+static void testPackedPalette()
+{
+  std::vector<uint8_t> file8 = randomFile(301, 203, 8);
+  std::vector<uint8_t> file4 = randomFile(301, 203, 4);
+  checkPackedPalette<PixelMono1>(file8, 8);
+  checkPackedPalette<PixelGray2>(file8, 8);
+  checkPackedPalette<PixelGray4>(file8, 8);
+  checkPackedPalette<PixelMono1>(file4, 4);
+  checkPackedPalette<PixelGray2>(file4, 4);
+
+  //the same bits or fewer stay indexes, which are no bigger.
+  std::vector<uint8_t> file1 = randomFile(301, 203, 1);
+  ESPBitmap color;
+  CHECK(color.DecodeFileBuffer(file1.data(), file1.size()) == BITMAP_SUCCESS);
+  ESPBitmapGray2 gray;
+  CHECK(gray.DecodeFileBuffer(file1.data(), file1.size()) == BITMAP_SUCCESS);
+  CHECK(sameAsColor(gray, color));
+}
+
+//------------------------------------------------------------------ setPremultipliedAlpha
+
+//a V4 image with an alpha mask decodes the same from a buffer and a stream (the stream only learns it has
+//alpha once the masks are in), and BI_RGB images only take the 32bpp path when their 4th bytes are alpha.
+static void testPremultipliedAlpha()
+{
+  const uint32_t masks[] = { 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000 };
+  std::vector<uint8_t> pixels(4 * 29 * 17);
+  for(uint8_t &byte : pixels)
+    byte = randomByte();
+  std::vector<uint8_t> file = makeFile(29, 17, 32, BI_BITFIELDS, 108, masks, 0, pixels);
+
+  ESPBitmap buffered;
+  buffered.setPremultipliedAlpha(true);
+  CHECK(buffered.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+  ESPBitmap streamed;
+  streamed.setPremultipliedAlpha(true);
+  MemoryStream stream(file, 7);
+  CHECK(streamed.getFromStream(&stream, file.size(), 1000) == BITMAP_SUCCESS);
+  bool same = true, alpha = true;
+  for(int y = 0; y < 17; y++){
+    for(int x = 0; x < 29; x++){
+      if(!samePixel(buffered.getPixel(x, y), streamed.getPixel(x, y)))
+        same = false;
+      if(buffered.getPixel(x, y).a != pixels[4 * (29 * (16 - y) + x) + 3])
+        alpha = false;
+    }
+  }
+  CHECK(same);
+  CHECK(alpha);
+
+  //4th bytes all 0 or all 255 are opaque, converted to RGB565 like without setPremultipliedAlpha.
+  for(uint8_t fill : { 0, 255 }){
+    std::vector<uint8_t> opaquePixels(4 * 64 * 32);
+    for(size_t i = 0; i < opaquePixels.size(); i++)
+      opaquePixels[i] = (i % 4 == 3) ? fill : randomByte();
+    std::vector<uint8_t> opaqueFile = makeFile(64, 32, 32, BI_UNCOMPRESSED, 40, 0, 0, opaquePixels);
+    ESPBitmap16 plain;
+    CHECK(plain.DecodeFileBuffer(opaqueFile.data(), opaqueFile.size()) == BITMAP_SUCCESS);
+    ESPBitmap16 opaque;
+    opaque.setPremultipliedAlpha(true);
+    CHECK(opaque.DecodeFileBuffer(opaqueFile.data(), opaqueFile.size()) == BITMAP_SUCCESS);
+    CHECK(opaque.storageCapacity() == plain.storageCapacity());
+    CHECK(opaque.storageCapacity() <= 64 * 32 * 2 + 64);
+    CHECK(opaque.getPixel(5, 7) == plain.getPixel(5, 7));
+  }
+
+  //while a mix of them is alpha.
+  std::vector<uint8_t> mixed(4 * 64 * 32);
+  for(size_t i = 0; i < mixed.size(); i++)
+    mixed[i] = (i % 4 == 3) ? ((i / 4) % 2 ? 255 : 0) : randomByte();
+  std::vector<uint8_t> mixedFile = makeFile(64, 32, 32, BI_UNCOMPRESSED, 40, 0, 0, mixed);
+  ESPBitmap icon;
+  icon.setPremultipliedAlpha(true);
+  CHECK(icon.DecodeFileBuffer(mixedFile.data(), mixedFile.size()) == BITMAP_SUCCESS);
+  CHECK(icon.getPixel(0, 0).a == 0);
+  CHECK(icon.getPixel(1, 0).a == 255);
+}
+
+//------------------------------------------------------------------ setWorkers
+
+//decodes file with 1 worker and with 3, reduced to targetWidth when it's set, and says whether every row matched.
+template<typename Bitmap>
+static bool sameWithWorkers(const std::vector<uint8_t> &file, int targetWidth, BITMAP_SCALE_t filter, bool dither)
+{
+  Bitmap serial, parallel;
+  Bitmap *bitmaps[] = { &serial, &parallel };
+  for(Bitmap *bitmap : bitmaps){
+    if(targetWidth > 0)
+      bitmap->setDecodeSize(targetWidth, 0, filter);
+    bitmap->setDither(dither);
+    bitmap->setWorkers(bitmap == &serial ? 1 : 3);
+    if(bitmap->DecodeFileBuffer((uint8_t *)file.data(), file.size()) != BITMAP_SUCCESS)
+      return false;
+  }
+  if(serial.getWidth() != parallel.getWidth() || serial.getHeight() != parallel.getHeight())
+    return false;
+  std::vector<typename Bitmap::Pixel> serialRow(serial.getWidth()), parallelRow(serial.getWidth());
+  for(int y = 0; y < serial.getHeight(); y++){
+    serial.copyRow(y, 0, serial.getWidth(), serialRow.data());
+    parallel.copyRow(y, 0, serial.getWidth(), parallelRow.data());
+    if(memcmp(serialRow.data(), parallelRow.data(), serialRow.size() * sizeof(serialRow[0])) != 0)
+      return false;
+  }
+  return true;
+}
+
+//splitting a decode across workers gives exactly the image one worker does, converted, reduced or dithered.
+static void testWorkers()
+{
+  for(int bitsPerPixel : { 1, 4, 8, 16, 24, 32 }){
+    std::vector<uint8_t> file = randomFile(301, 203, bitsPerPixel);
+    CHECK(sameWithWorkers<ESPBitmap>(file, 0, BITMAP_SCALE_NEAREST, false));
+    CHECK(sameWithWorkers<ESPBitmap16>(file, 0, BITMAP_SCALE_NEAREST, false));
+    CHECK(sameWithWorkers<ESPBitmap16>(file, 97, BITMAP_SCALE_NEAREST, false));
+    CHECK(sameWithWorkers<ESPBitmap16>(file, 97, BITMAP_SCALE_BOX, false));
+    CHECK(sameWithWorkers<ESPBitmapMono>(file, 0, BITMAP_SCALE_NEAREST, true));
+  }
+}
+
+//------------------------------------------------------------------ bad headers
+
+//headers that would put the pixel data before the file or give the image no width are turned away
+//by every way in, instead of being read from. the first is a 152 byte RLE8 file that used to crash.
+//RLE data lengths that don't fit the file are cut down to it, or turned away.
+static void testBadHeaders()
+{
+  //a run of 8 and an end of line for each row, then padding.
+  std::vector<uint8_t> rle(34, 0);
+  for(int row = 0; row < 4; row++){
+    rle[4 * row] = 8;
+    rle[4 * row + 1] = row;
+  }
+  std::vector<uint8_t> file = makeFile(8, 4, 8, BI_RLE_8, 40, 0, 16, rle);
+  CHECK(file.size() == 152);
+  put32(file, 10, 0xAE000436);
+
+  std::vector<uint8_t> noWidth = randomFile(8, 4, 24);
+  put32(noWidth, 18, 0);
+  std::vector<uint8_t> negativeWidth = randomFile(8, 4, 24);
+  put32(negativeWidth, 18, (uint32_t)-8);
+
+  //rows that add up to more than an int32_t (a wrapped size on the ESP), and an image missing its last row.
+  std::vector<uint8_t> tall = randomFile(8, 4, 8);
+  put32(tall, 22, 0x7FFFFFFF);
+  std::vector<uint8_t> short8 = randomFile(8, 4, 8);
+  short8.resize(short8.size() - 8);
+
+  struct { std::vector<uint8_t> &file; BITMAP_RESULT_t result; } cases[] = {
+    { file, BITMAP_ERROR_INVALID_FHEADER },
+    { noWidth, BITMAP_ERROR_INVALID_IHEADER },
+    { negativeWidth, BITMAP_ERROR_INVALID_IHEADER },
+    { tall, BITMAP_ERROR_INVALID_IHEADER },
+    { short8, BITMAP_ERROR_TOO_SHORT },
+  };
+  for(auto &c : cases){
+    ESPBitmap bitmap;
+    CHECK(bitmap.DecodeFileBuffer(c.file.data(), c.file.size()) == c.result);
+    ESPBitmap16 keptCompressed;
+    keptCompressed.setKeepCompressed(true);
+    CHECK(keptCompressed.DecodeFileBuffer(c.file.data(), c.file.size()) == c.result);
+    ESPBitmap scaled;
+    scaled.setDecodeSize(4, 2);
+    CHECK(scaled.DecodeFileBuffer(c.file.data(), c.file.size()) == c.result);
+    ESPBitmap streamed;
+    MemoryStream stream(c.file, 7);
+    CHECK(streamed.getFromStream(&stream, c.file.size(), 1000) == c.result);
+    //nothing is reserved for an image that isn't going to load.
+    CHECK(bitmap.storageCapacity() == 0 && streamed.storageCapacity() == 0);
+  }
+
+  FILE *disk = diskFile(tall);
+  CHECK(disk != 0);
+  if(disk != 0){
+    ESPBitmapStdioSource source(disk);
+    ESPBitmapFile bitmap;
+    CHECK(bitmap.open(&source) == BITMAP_ERROR_INVALID_IHEADER);
+    fclose(disk);
+  }
+
+  //RLE data lengths are only what the file can hold: a 62 byte RLE8 file claiming 0xF0000000 bytes of data
+  //loads what's there, and whether or not the stream's length is known nothing asks for gigabytes first.
+  const uint8_t row[] = { 2, 0, 0, 1 };
+  std::vector<uint8_t> huge = makeFile(2, 1, 8, BI_RLE_8, 40, 0, 1, std::vector<uint8_t>(row, row + 4));
+  put32(huge, 46, 1);
+  put32(huge, 34, 0xF0000000);
+  CHECK(huge.size() == 62);
+  for(bool keep : { false, true }){
+    for(int len : { (int)huge.size(), -1 }){
+      ESPBitmap bitmap;
+      bitmap.setKeepCompressed(keep);
+      MemoryStream stream(huge, 5);
+      //without a length the load waits for more until it times out.
+      BITMAP_RESULT_t result = bitmap.getFromStream(&stream, len, len < 0 ? 20 : 1000);
+      CHECK(result == (len < 0 ? BITMAP_ERROR_FETCH_FAILED : BITMAP_SUCCESS));
+      CHECK(bitmap.storageCapacity() < 4096);
+#ifdef ESPBITMAP_STATS
+      CHECK(bitmap.stats.peakBytes < 8192);
+#endif
+    }
+    ESPBitmap buffered;
+    buffered.setKeepCompressed(keep);
+    CHECK(buffered.DecodeFileBuffer(huge.data(), huge.size()) == BITMAP_SUCCESS);
+    CHECK(buffered.storageCapacity() < 4096);
+  }
+
+  //without a data size the file size says, and one smaller than the data offset is turned away.
+  put32(huge, 34, 0);
+  put32(huge, 2, 20);
+  ESPBitmap truncated;
+  MemoryStream truncatedStream(huge, 5);
+  CHECK(truncated.getFromStream(&truncatedStream, -1, 1000) == BITMAP_ERROR_TOO_SHORT);
+  CHECK(truncated.DecodeFileBuffer(huge.data(), huge.size()) == BITMAP_ERROR_TOO_SHORT);
+}
+
+//------------------------------------------------------------------ short palettes
+
+//a 5x3 8bpp image with a 2 color palette, and indexes past it in every row.
+static const uint8_t shortIndexes[3][5] = { { 0, 1, 200, 255, 2 }, { 1, 0, 1, 0, 1 }, { 200, 2, 0, 3, 1 } };
+
+static std::vector<uint8_t> shortPaletteFile()
+{
+  std::vector<uint8_t> pixels(8 * 3, 0);
+  for(int y = 0; y < 3; y++)
+    for(int x = 0; x < 5; x++)
+      pixels[8 * (2 - y) + x] = shortIndexes[y][x];
+  std::vector<uint8_t> file = makeFile(5, 3, 8, BI_UNCOMPRESSED, 40, 0, 2, pixels);
+  put32(file, 46, 2);
+  return file;
+}
+
+//every pixel of bitmap is its palette color, or ERROR_COLOR's magenta for an index the palette doesn't have,
+//from getPixel and copyRow alike.
+template<class Format>
+static bool shortPaletteColors(ESPBitmapT<Format> &bitmap, const std::vector<uint8_t> &file)
+{
+  if(bitmap.getWidth() != 5 || bitmap.getHeight() != 3)
+    return false;
+  for(int y = 0; y < 3; y++){
+    typename Format::Pixel row[5];
+    if(bitmap.copyRow(y, 0, 5, row) != 5)
+      return false;
+    for(int x = 0; x < 5; x++){
+      uint8_t index = shortIndexes[y][x];
+      const uint8_t *bgra = &file[54 + 4 * index];
+      typename Format::Pixel expected = index < 2 ? Format::fromRGBA(bgra[2], bgra[1], bgra[0], 0)
+                                                  : Format::fromRGBA(255, 0, 255, 0);
+      if(memcmp(&row[x], &expected, sizeof(expected)) != 0)
+        return false;
+      typename Format::Pixel pixel = bitmap.getPixel(x, y);
+      if(memcmp(&pixel, &expected, sizeof(expected)) != 0)
+        return false;
+    }
+  }
+  return true;
+}
+
+template<class Format>
+static void checkShortPalette(const std::vector<uint8_t> &file)
+{
+  ESPBitmapT<Format> buffered;
+  CHECK(buffered.DecodeFileBuffer((uint8_t *)file.data(), file.size()) == BITMAP_SUCCESS);
+  CHECK(shortPaletteColors(buffered, file));
+
+  ESPBitmapT<Format> streamed;
+  MemoryStream stream(file, 7);
+  CHECK(streamed.getFromStream(&stream, file.size(), 1000) == BITMAP_SUCCESS);
+  CHECK(shortPaletteColors(streamed, file));
+}
+
+//indexes past a palette shorter than the bits can hold come out as ERROR_COLOR however the image is read,
+//instead of whatever the block holds after the palette.
+static void testShortPalette()
+{
+  std::vector<uint8_t> file = shortPaletteFile();
+  checkShortPalette<PixelRGB888>(file);
+  checkShortPalette<PixelRGB565>(file);
+  checkShortPalette<PixelGray4>(file);
+
+  ESPBitmap reference;
+  CHECK(reference.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+  ESPBitmap bitmap;
+  MemoryStream stream(file, 7);
+  streamReference = &reference;
+  streamRows = 0;
+  streamLastY = -1;
+  streamRowsMatch = true;
+  streamInOrder = true;
+  CHECK(bitmap.StreamDecode(&stream, file.size(), 1000, streamRow) == BITMAP_SUCCESS);
+  CHECK(streamRows == 3);
+  CHECK(streamRowsMatch);
+}
+
+//a short palette image repacks to the same pixels, its ERROR_COLORs among them, in fewer bits.
+template<class Format>
+static void checkShortPaletteRepack(const std::vector<uint8_t> &file, const std::vector<uint8_t> &indexes)
+{
+  ESPBitmapT<Format> plain;
+  CHECK(plain.DecodeFileBuffer((uint8_t *)file.data(), file.size()) == BITMAP_SUCCESS);
+  ESPBitmapT<Format> buffered;
+  buffered.setRepack(true);
+  CHECK(buffered.DecodeFileBuffer((uint8_t *)file.data(), file.size()) == BITMAP_SUCCESS);
+  ESPBitmapT<Format> streamed;
+  streamed.setRepack(true);
+  MemoryStream stream(file, 7);
+  CHECK(streamed.getFromStream(&stream, file.size(), 1000) == BITMAP_SUCCESS);
+
+  ESPBitmapT<Format> *repacked[] = { &buffered, &streamed };
+  for(ESPBitmapT<Format> *bitmap : repacked){
+    CHECK(bitmap->getWidth() == plain.getWidth() && bitmap->getHeight() == plain.getHeight());
+    CHECK(bitmap->storageCapacity() < plain.storageCapacity());
+    bool same = true, errors = true;
+    typename Format::Pixel error = Format::fromRGBA(255, 0, 255, 0);
+    for(int y = 0; y < plain.getHeight(); y++){
+      for(int x = 0; x < plain.getWidth(); x++){
+        typename Format::Pixel a = plain.getPixel(x, y), b = bitmap->getPixel(x, y);
+        if(memcmp(&a, &b, sizeof(a)) != 0)
+          same = false;
+        if(indexes[plain.getWidth() * (plain.getHeight() - 1 - y) + x] >= 2 && memcmp(&b, &error, sizeof(b)) != 0)
+          errors = false;
+      }
+    }
+    CHECK(same);
+    CHECK(errors);
+  }
+}
+
+static void testShortPaletteRepack()
+{
+  //indexes 0 and 1 of a 2 color palette, and 7 and 200 past it.
+  const uint8_t indexes[] = { 0, 1, 7, 200 };
+  std::vector<uint8_t> pixels(64 * 32);
+  for(uint8_t &byte : pixels)
+    byte = indexes[randomByte() % 4];
+  std::vector<uint8_t> file = makeFile(64, 32, 8, BI_UNCOMPRESSED, 40, 0, 2, pixels);
+  put32(file, 46, 2);
+  checkShortPaletteRepack<PixelRGB888>(file, pixels);
+  checkShortPaletteRepack<PixelRGB565>(file, pixels);
+}
+
+//------------------------------------------------------------------ RLE
+
+//an RLE image, stored rows from the bottom up as the file has them, and the indexes its data decodes to.
+struct RLEImage {
+  int width;
+  int height;
+  int bitsPerPixel;
+  std::vector<uint8_t> data;
+  std::vector<uint8_t> indexes;
+};
+
+static RLEImage rle8Image()
+{
+  RLEImage image;
+  image.width = 8;
+  image.height = 4;
+  image.bitsPerPixel = 8;
+  const uint8_t data[] = {
+    3, 5, 0, 3, 1, 2, 3, 0, 2, 7, 0, 0,   //a run, an odd absolute run and its pad byte, a run, end of line
+    2, 4, 0, 2, 3, 1,                     //a run, then a delta 3 right and a row up
+    0, 3, 9, 10, 11, 0, 0, 0,             //an absolute run from x 5, end of line
+    0, 5, 1, 2, 3, 4, 5, 0, 0, 2, 2, 0,   //an odd absolute run, a delta 2 right on the same row
+    1, 6, 0, 1                            //a run of 1, end of bitmap
+  };
+  const uint8_t indexes[] = {
+    5, 5, 5, 1, 2, 3, 7, 7,
+    4, 4, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 9, 10, 11,
+    1, 2, 3, 4, 5, 0, 0, 6
+  };
+  image.data.assign(data, data + sizeof(data));
+  image.indexes.assign(indexes, indexes + sizeof(indexes));
+  return image;
+}
+
+static RLEImage rle4Image()
+{
+  RLEImage image;
+  image.width = 7;
+  image.height = 4;
+  image.bitsPerPixel = 4;
+  const uint8_t data[] = {
+    4, 0x12, 0, 3, 0x34, 0x50, 0, 0,           //a run of alternating nibbles, a 3 pixel absolute run unpadded
+    0, 5, 0x56, 0x78, 0x90, 0, 0, 2, 1, 1,     //a 5 pixel absolute run padded, a delta 1 right and a row up
+    1, 0xA0, 0, 0,                             //a run of 1 at x 6, end of line
+    0, 3, 0xBC, 0xD0, 4, 0xEF, 0, 1            //another, a run, end of bitmap
+  };
+  const uint8_t indexes[] = {
+    1, 2, 1, 2, 3, 4, 5,
+    5, 6, 7, 8, 9, 0, 0,
+    0, 0, 0, 0, 0, 0, 10,
+    11, 12, 13, 14, 15, 14, 15
+  };
+  image.data.assign(data, data + sizeof(data));
+  image.indexes.assign(indexes, indexes + sizeof(indexes));
+  return image;
+}
+
+//every pixel of bitmap, from getPixel and from copyRow, is the palette color of its index in image.
+template<class Format>
+static bool sameAsRLE(ESPBitmapT<Format> &bitmap, const RLEImage &image, const std::vector<uint8_t> &file)
+{
+  if(bitmap.getWidth() != image.width || bitmap.getHeight() != image.height)
+    return false;
+  std::vector<typename Format::Pixel> row(image.width);
+  for(int y = 0; y < image.height; y++){
+    if(bitmap.copyRow(y, 0, image.width, row.data()) != image.width)
+      return false;
+    for(int x = 0; x < image.width; x++){
+      const uint8_t *bgra = &file[54 + 4 * image.indexes[image.width * (image.height - 1 - y) + x]];
+      typename Format::Pixel expected = Format::fromRGBA(bgra[2], bgra[1], bgra[0], 0);
+      typename Format::Pixel pixel = bitmap.getPixel(x, y);
+      if(memcmp(&pixel, &expected, sizeof(expected)) != 0 || memcmp(&row[x], &expected, sizeof(expected)) != 0)
+        return false;
+    }
+  }
+  return true;
+}
+
+//the image as a file with a palette of 16 random colors.
+static std::vector<uint8_t> rleFile(const RLEImage &image)
+{
+  std::vector<uint8_t> file = makeFile(image.width, image.height, image.bitsPerPixel,
+                                       image.bitsPerPixel == 8 ? BI_RLE_8 : BI_RLE_4, 40, 0, 16, image.data);
+  put32(file, 46, 16);
+  return file;
+}
+
+template<class Format>
+static void checkRLE(const RLEImage &image)
+{
+  std::vector<uint8_t> file = rleFile(image);
+  for(bool keep : { false, true }){
+    for(bool borrow : { false, true }){
+      ESPBitmapT<Format> buffered;
+      buffered.setKeepCompressed(keep);
+      buffered.setBorrowBuffer(borrow);
+      CHECK(buffered.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+      CHECK(sameAsRLE(buffered, image, file));
+    }
+    for(size_t chunk : { 1, 3, 7, 64 }){
+      ESPBitmapT<Format> streamed;
+      streamed.setKeepCompressed(keep);
+      MemoryStream stream(file, chunk);
+      CHECK(streamed.getFromStream(&stream, file.size(), 1000) == BITMAP_SUCCESS);
+      CHECK(sameAsRLE(streamed, image, file));
+    }
+  }
+}
+
+//rows StreamDecode gives for an RLE image, rows it doesn't give stay 0.
+static std::vector<PIXEL_t> rleStreamPixels;
+static int rleStreamWidth;
+
+static void rleStreamRow(int y, PIXEL_t *pixels, int width)
+{
+  if(width == rleStreamWidth)
+    memcpy(&rleStreamPixels[width * y], pixels, width * sizeof(PIXEL_t));
+}
+
+//hand made RLE8 and RLE4 data, with runs, deltas across and within rows, and absolute runs odd and even, padded
+//and not, decodes to the same indexes expanded, kept compressed, borrowed, streamed in pieces and by StreamDecode.
+static void testRLE()
+{
+  RLEImage images[] = { rle8Image(), rle4Image() };
+  for(const RLEImage &image : images){
+    checkRLE<PixelRGB888>(image);
+    checkRLE<PixelRGB565>(image);
+
+    std::vector<uint8_t> file = rleFile(image);
+    ESPBitmap reference;
+    CHECK(reference.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+    //any row StreamDecode leaves out has to be background, index 0.
+    size_t first0 = std::find(image.indexes.begin(), image.indexes.end(), 0) - image.indexes.begin();
+    PIXEL_t background = reference.getPixel(first0 % image.width, image.height - 1 - first0 / image.width);
+    rleStreamPixels.assign(image.width * image.height, background);
+    rleStreamWidth = image.width;
+    ESPBitmap bitmap;
+    MemoryStream stream(file, 5);
+    CHECK(bitmap.StreamDecode(&stream, file.size(), 1000, rleStreamRow) == BITMAP_SUCCESS);
+    bool same = true;
+    for(int y = 0; y < image.height; y++)
+      for(int x = 0; x < image.width; x++)
+        if(!samePixel(rleStreamPixels[image.width * y + x], reference.getPixel(x, y)))
+          same = false;
+    CHECK(same);
+  }
+}
+
+//------------------------------------------------------------------ copyRow and copyRect
+
+//copyRow and copyRect give getPixel's pixels, clipped to the image, leaving the rest of dst as it was.
+template<class Format>
+static void checkCopies(const std::vector<uint8_t> &file)
+{
+  typedef typename Format::Pixel Pixel;
+  ESPBitmapT<Format> bitmap;
+  CHECK(bitmap.DecodeFileBuffer((uint8_t *)file.data(), file.size()) == BITMAP_SUCCESS);
+  int width = bitmap.getWidth(), height = bitmap.getHeight();
+  Pixel fill;
+  memset(&fill, 0xA5, sizeof(fill));
+
+  //a row starting before the image and running past it: 3 untouched pixels at each end.
+  bool rows = true;
+  std::vector<Pixel> row(width + 6, fill);
+  for(int y = 0; y < height; y++){
+    std::fill(row.begin(), row.end(), fill);
+    if(bitmap.copyRow(y, -3, width + 6, row.data()) != width)
+      rows = false;
+    for(int x = -3; x < width + 3; x++){
+      Pixel expected = (x >= 0 && x < width) ? bitmap.getPixel(x, y) : fill;
+      if(memcmp(&row[x + 3], &expected, sizeof(Pixel)) != 0)
+        rows = false;
+    }
+  }
+  CHECK(rows);
+  CHECK(bitmap.copyRow(-1, 0, width, row.data()) == 0);
+  CHECK(bitmap.copyRow(height, 0, width, row.data()) == 0);
+  CHECK(bitmap.copyRow(0, width, 5, row.data()) == 0);
+
+  //a block hanging off the bottom right corner, into a wider dst.
+  int x0 = width - 10, y0 = height - 7, w = 16, h = 12, stride = 20;
+  std::vector<Pixel> rect(stride * h, fill);
+  CHECK(bitmap.copyRect(x0, y0, w, h, rect.data(), stride) == 10 * 7);
+  bool same = true;
+  for(int j = 0; j < h; j++){
+    for(int i = 0; i < stride; i++){
+      bool inside = i < w && x0 + i < width && y0 + j < height;
+      Pixel expected = inside ? bitmap.getPixel(x0 + i, y0 + j) : fill;
+      if(memcmp(&rect[stride * j + i], &expected, sizeof(Pixel)) != 0)
+        same = false;
+    }
+  }
+  CHECK(same);
+
+  //and off the top left.
+  std::fill(rect.begin(), rect.end(), fill);
+  CHECK(bitmap.copyRect(-4, -2, w, h, rect.data(), stride) == 12 * 10);
+  CHECK(memcmp(&rect[0], &fill, sizeof(Pixel)) == 0);
+  Pixel corner = bitmap.getPixel(0, 0);
+  CHECK(memcmp(&rect[stride * 2 + 4], &corner, sizeof(Pixel)) == 0);
+}
+
+static void testCopyRow()
+{
+  for(int bitsPerPixel : { 1, 4, 8, 16, 24, 32 }){
+    std::vector<uint8_t> file = randomFile(37, 21, bitsPerPixel);
+    checkCopies<PixelRGB888>(file);
+    checkCopies<PixelRGB565>(file);
+    checkCopies<PixelGray4>(file);
+    checkCopies<PixelMono1>(file);
+  }
+}
+
+//------------------------------------------------------------------ bitfields
+
+//a channel of bits bits widened to 8 by repeating it from the top, the way a 5 bit 31 still reaches 255.
+static uint8_t widenChannel(uint32_t value, int bits)
+{
+  if(bits >= 8)
+    return value >> (bits - 8);
+  uint8_t wide = 0;
+  for(int i = 0; i < 8; i++)
+    wide |= ((value >> (bits - 1 - i % bits)) & 1) << (7 - i);
+  return wide;
+}
+
+//the channel of pixel under mask, widened to 8 bits.
+static uint8_t maskedChannel(uint32_t pixel, uint32_t mask)
+{
+  int low = 0, bits = 0;
+  while(!(mask & (1UL << low)))
+    low++;
+  while(low + bits < 32 && (mask & (1UL << (low + bits))))
+    bits++;
+  return widenChannel((pixel & mask) >> low, bits);
+}
+
+//a random BI_BITFIELDS image decodes to the colors its masks say, from a buffer and a stream,
+//in ESPBitmap and ESPBitmap16, with the masks after a 40 byte header or in a V4 one.
+static void checkBitfields(int bitsPerPixel, const uint32_t *masks, int headerSize)
+{
+  const int width = 23, height = 9;
+  size_t scanlineWidth = 4 * ((width * bitsPerPixel + 31) / 32);
+  std::vector<uint8_t> pixels(scanlineWidth * height);
+  for(uint8_t &byte : pixels)
+    byte = randomByte();
+  std::vector<uint8_t> file = makeFile(width, height, bitsPerPixel, BI_BITFIELDS, headerSize, masks, 0, pixels);
+
+  ESPBitmap buffered, streamed;
+  ESPBitmap16 buffered16, streamed16;
+  CHECK(buffered.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+  CHECK(buffered16.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+  MemoryStream stream(file, 7), stream16(file, 7);
+  CHECK(streamed.getFromStream(&stream, file.size(), 1000) == BITMAP_SUCCESS);
+  CHECK(streamed16.getFromStream(&stream16, file.size(), 1000) == BITMAP_SUCCESS);
+
+  bool colors = true, colors16 = true;
+  for(int y = 0; y < height; y++){
+    for(int x = 0; x < width; x++){
+      const uint8_t *bytes = &pixels[scanlineWidth * (height - 1 - y) + x * bitsPerPixel / 8];
+      uint32_t pixel = bitsPerPixel == 16 ? (bytes[0] | bytes[1] << 8)
+                                          : (bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24);
+      uint8_t r = maskedChannel(pixel, masks[0]), g = maskedChannel(pixel, masks[1]), b = maskedChannel(pixel, masks[2]);
+      ESPBitmap *bitmaps[] = { &buffered, &streamed };
+      for(ESPBitmap *bitmap : bitmaps){
+        PIXEL_t c = bitmap->getPixel(x, y);
+        if(c.r != r || c.g != g || c.b != b)
+          colors = false;
+      }
+      uint16_t expected16 = PixelRGB565::fromRGBA(r, g, b, 0);
+      if(buffered16.getPixel(x, y) != expected16 || streamed16.getPixel(x, y) != expected16)
+        colors16 = false;
+    }
+  }
+  CHECK(colors);
+  CHECK(colors16);
+}
+
+//555, 565, 4444 and 10 bit channels, with and without alpha, come out as their masks say, and a 555
+//BI_BITFIELDS image is the same as the BI_RGB 16bpp one it spells out.
+static void testBitfields()
+{
+  const uint32_t masks555[] = { 0x7C00, 0x03E0, 0x001F, 0 };
+  const uint32_t masks565[] = { 0xF800, 0x07E0, 0x001F, 0 };
+  const uint32_t masks4444[] = { 0x0F00, 0x00F0, 0x000F, 0xF000 };
+  const uint32_t masks1010102[] = { 0x3FF00000, 0x000FFC00, 0x000003FF, 0xC0000000 };
+  const uint32_t masks888[] = { 0x000000FF, 0x0000FF00, 0x00FF0000, 0 };
+  for(int headerSize : { 40, 108 }){
+    checkBitfields(16, masks555, headerSize);
+    checkBitfields(16, masks565, headerSize);
+    checkBitfields(32, masks888, headerSize);
+  }
+  checkBitfields(16, masks4444, 108);
+  checkBitfields(32, masks1010102, 108);
+  checkBitfields(32, masks1010102, 40);
+
+  std::vector<uint8_t> plainFile = randomFile(23, 9, 16);
+  std::vector<uint8_t> pixels(plainFile.begin() + 54, plainFile.end());
+  std::vector<uint8_t> maskedFile = makeFile(23, 9, 16, BI_BITFIELDS, 40, masks555, 0, pixels);
+  ESPBitmap plain, masked;
+  CHECK(plain.DecodeFileBuffer(plainFile.data(), plainFile.size()) == BITMAP_SUCCESS);
+  CHECK(masked.DecodeFileBuffer(maskedFile.data(), maskedFile.size()) == BITMAP_SUCCESS);
+  bool same = true;
+  for(int y = 0; y < 9; y++)
+    for(int x = 0; x < 23; x++)
+      if(!samePixel(plain.getPixel(x, y), masked.getPixel(x, y)))
+        same = false;
+  CHECK(same);
+}
+
+//------------------------------------------------------------------ setBorrowBuffer
+
+//a borrowed image has the pixels of a copied one without a copy of the pixel data, and reads the caller's
+//buffer in place. images that have to be converted still get memory of their own.
+template<class Format>
+static void checkBorrow(std::vector<uint8_t> file, bool readsInPlace)
+{
+  typedef typename Format::Pixel Pixel;
+  ESPBitmapT<Format> copied;
+  CHECK(copied.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+  ESPBitmapT<Format> borrowed;
+  borrowed.setBorrowBuffer(true);
+  CHECK(borrowed.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+  CHECK(borrowed.getWidth() == copied.getWidth() && borrowed.getHeight() == copied.getHeight());
+  int width = copied.getWidth();
+  std::vector<Pixel> copiedRow(width), borrowedRow(width);
+  bool same = true;
+  for(int y = 0; y < copied.getHeight(); y++){
+    copied.copyRow(y, 0, width, copiedRow.data());
+    borrowed.copyRow(y, 0, width, borrowedRow.data());
+    if(memcmp(copiedRow.data(), borrowedRow.data(), width * sizeof(Pixel)) != 0)
+      same = false;
+    Pixel a = copied.getPixel(width - 1, y), b = borrowed.getPixel(width - 1, y);
+    if(memcmp(&a, &b, sizeof(Pixel)) != 0)
+      same = false;
+  }
+  CHECK(same);
+
+  size_t dataOffset = file[10] | file[11] << 8;
+  size_t pixelBytes = file.size() - dataOffset;
+  if(readsInPlace){
+    CHECK(borrowed.storageCapacity() + pixelBytes <= copied.storageCapacity());
+    //the top row is the last one in the file, changing it shows through.
+    Pixel before = borrowed.getPixel(0, 0);
+    size_t scanlineWidth = pixelBytes / copied.getHeight();
+    for(size_t i = file.size() - scanlineWidth; i < file.size(); i++)
+      file[i] ^= 0xFF;
+    Pixel after = borrowed.getPixel(0, 0);
+    CHECK(memcmp(&before, &after, sizeof(Pixel)) != 0);
+  }
+  else
+    CHECK(borrowed.storageCapacity() == copied.storageCapacity());
+}
+
+static void testBorrow()
+{
+  for(int bitsPerPixel : { 1, 4, 8, 16, 24, 32 }){
+    std::vector<uint8_t> file = randomFile(37, 21, bitsPerPixel);
+    checkBorrow<PixelRGB888>(file, true);
+    checkBorrow<PixelRGB565>(file, bitsPerPixel <= 8);
+  }
+}
+
+//------------------------------------------------------------------ RGB565 conversion
+
+//fromBGR24 and fromBGRA32 give Color()'s pixels from any alignment and any count, the word at a time
+//part and the pixels either side of it alike, and write nothing past count.
+static void testConvert565()
+{
+  uint8_t bgr[4 * 20 + 4];
+  for(uint8_t &byte : bgr)
+    byte = randomByte();
+  bool same = true, swapped = true, contained = true;
+  for(int offset = 0; offset < 4; offset++){
+    for(int count = 0; count <= 17; count++){
+      for(int bytes : { 3, 4 }){
+        const uint8_t *src = bgr + offset;
+        uint16_t dst[20], dstSwapped[20];
+        memset(dst, 0xA5, sizeof(dst));
+        memset(dstSwapped, 0xA5, sizeof(dstSwapped));
+        if(bytes == 3){
+          PixelRGB565::fromBGR24(src, count, dst);
+          PixelRGB565Swapped::fromBGR24(src, count, dstSwapped);
+        }
+        else {
+          PixelRGB565::fromBGRA32(src, count, dst, false);
+          PixelRGB565Swapped::fromBGRA32(src, count, dstSwapped, false);
+        }
+        for(int i = 0; i < count; i++){
+          const uint8_t *p = src + bytes * i;
+          uint16_t expected = ESPBitmapBase::Color(p[2], p[1], p[0]);
+          if(dst[i] != expected)
+            same = false;
+          if(dstSwapped[i] != (uint16_t)(expected >> 8 | expected << 8))
+            swapped = false;
+        }
+        for(int i = count; i < 20; i++)
+          if(dst[i] != 0xA5A5 || dstSwapped[i] != 0xA5A5)
+            contained = false;
+      }
+    }
+  }
+  CHECK(same);
+  CHECK(swapped);
+  CHECK(contained);
+
+  //and whole images of every width up to a few words, whole and windowed so rows start off a word boundary,
+  //match ESPBitmap's pixels made RGB565 from a buffer and a stream.
+  for(int width = 1; width <= 13; width++){
+    std::vector<uint8_t> file = randomFile(width, 5, 24);
+    ESPBitmap color;
+    CHECK(color.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+    ESPBitmap16 buffered;
+    CHECK(buffered.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+    CHECK(sameAsColor(buffered, color));
+    ESPBitmap16 streamed;
+    MemoryStream stream(file, 5);
+    CHECK(streamed.getFromStream(&stream, file.size(), 1000) == BITMAP_SUCCESS);
+    CHECK(sameAsColor(streamed, color));
+    for(int x = 1; x < 4 && x < width; x++){
+      ESPBitmap colorWindow;
+      colorWindow.setDecodeRect(x, 1, width - x, 3);
+      CHECK(colorWindow.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+      ESPBitmap16 window;
+      window.setDecodeRect(x, 1, width - x, 3);
+      CHECK(window.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+      CHECK(sameAsColor(window, colorWindow));
+    }
+  }
+}
+
+//------------------------------------------------------------------ setDecodeSize
+
+//the full size image row y of an image of height rows comes from, for reduced row y of size rows. rows are
+//picked in file order, so for a bottom up image the count starts at the bottom.
+static int nearestSourceRow(int y, int size, int height, bool flipped)
+{
+  int stored = flipped ? y : size - 1 - y;
+  int source = (int)((int64_t)(2 * stored + 1) * height / (2 * size));
+  return flipped ? source : height - 1 - source;
+}
+
+//a reduced decode is the full size decode sampled at the center of each pixel (nearest) or its colors averaged
+//over the pixels each one covers (box), from a buffer and a stream.
+template<class Format>
+static void checkDecodeSize(const std::vector<uint8_t> &file, int targetWidth, int targetHeight, BITMAP_SCALE_t filter)
+{
+  typedef typename Format::Pixel Pixel;
+  ESPBitmapT<Format> full;
+  CHECK(full.DecodeFileBuffer((uint8_t *)file.data(), file.size()) == BITMAP_SUCCESS);
+  int width = full.getWidth(), height = full.getHeight();
+  bool flipped = full.flipped;
+
+  ESPBitmapT<Format> buffered, streamed;
+  buffered.setDecodeSize(targetWidth, targetHeight, filter);
+  streamed.setDecodeSize(targetWidth, targetHeight, filter);
+  CHECK(buffered.DecodeFileBuffer((uint8_t *)file.data(), file.size()) == BITMAP_SUCCESS);
+  MemoryStream stream(file, 7);
+  CHECK(streamed.getFromStream(&stream, file.size(), 1000) == BITMAP_SUCCESS);
+  int w = targetWidth > 0 ? targetWidth : width * targetHeight / height;
+  int h = targetHeight > 0 ? targetHeight : height * targetWidth / width;
+  CHECK(buffered.getWidth() == w && buffered.getHeight() == h);
+  CHECK(streamed.getWidth() == w && streamed.getHeight() == h);
+  if(buffered.getWidth() != w || buffered.getHeight() != h || streamed.getWidth() != w || streamed.getHeight() != h)
+    return;
+
+  bool same = true;
+  for(int y = 0; y < h; y++){
+    for(int x = 0; x < w; x++){
+      Pixel expected;
+      if(filter == BITMAP_SCALE_NEAREST)
+        expected = full.getPixel((int)((int64_t)(2 * x + 1) * width / (2 * w)), nearestSourceRow(y, h, height, flipped));
+      else {
+        //every source pixel whose column and file order row fall in this one.
+        uint32_t sums[3] = { 0, 0, 0 }, n = 0;
+        int stored = flipped ? y : h - 1 - y;
+        for(int sy = 0; sy < height; sy++){
+          int sourceStored = flipped ? sy : height - 1 - sy;
+          if((int64_t)sourceStored * h / height != stored)
+            continue;
+          for(int sx = 0; sx < width; sx++){
+            if((int64_t)sx * w / width != x)
+              continue;
+            PIXEL_t c = Format::toRGBA(full.getPixel(sx, sy));
+            sums[0] += c.r;
+            sums[1] += c.g;
+            sums[2] += c.b;
+            n++;
+          }
+        }
+        expected = Format::fromRGBA((sums[0] + n / 2) / n, (sums[1] + n / 2) / n, (sums[2] + n / 2) / n, 0);
+      }
+      Pixel a = buffered.getPixel(x, y), b = streamed.getPixel(x, y);
+      if(memcmp(&a, &expected, sizeof(Pixel)) != 0 || memcmp(&b, &expected, sizeof(Pixel)) != 0)
+        same = false;
+    }
+  }
+  CHECK(same);
+}
+
+static void testDecodeSize()
+{
+  for(int bitsPerPixel : { 1, 4, 8, 16, 24, 32 }){
+    for(int height : { 53, -53 }){
+      std::vector<uint8_t> file = randomFile(77, height, bitsPerPixel);
+      checkDecodeSize<PixelRGB888>(file, 31, 0, BITMAP_SCALE_NEAREST);
+      checkDecodeSize<PixelRGB888>(file, 0, 20, BITMAP_SCALE_NEAREST);
+      checkDecodeSize<PixelRGB888>(file, 50, 11, BITMAP_SCALE_NEAREST);
+      checkDecodeSize<PixelRGB888>(file, 31, 0, BITMAP_SCALE_BOX);
+      checkDecodeSize<PixelRGB888>(file, 25, 24, BITMAP_SCALE_BOX);
+      checkDecodeSize<PixelRGB565>(file, 50, 11, BITMAP_SCALE_NEAREST);
+      checkDecodeSize<PixelRGB565>(file, 25, 24, BITMAP_SCALE_BOX);
+    }
+  }
+}
+
+//------------------------------------------------------------------ setDecodeRect
+
+//a windowed decode is the window of the full size decode, clipped to the image, from a buffer and a stream.
+template<class Format>
+static void checkDecodeRect(const std::vector<uint8_t> &file, int x0, int y0, int w, int h)
+{
+  typedef typename Format::Pixel Pixel;
+  ESPBitmapT<Format> full;
+  CHECK(full.DecodeFileBuffer((uint8_t *)file.data(), file.size()) == BITMAP_SUCCESS);
+  int left = x0 > 0 ? x0 : 0, top = y0 > 0 ? y0 : 0;
+  int right = x0 + w < full.getWidth() ? x0 + w : full.getWidth();
+  int bottom = y0 + h < full.getHeight() ? y0 + h : full.getHeight();
+
+  ESPBitmapT<Format> buffered, streamed;
+  buffered.setDecodeRect(x0, y0, w, h);
+  streamed.setDecodeRect(x0, y0, w, h);
+  BITMAP_RESULT_t result = buffered.DecodeFileBuffer((uint8_t *)file.data(), file.size());
+  MemoryStream stream(file, 7);
+  BITMAP_RESULT_t streamResult = streamed.getFromStream(&stream, file.size(), 1000);
+  if(left >= right || top >= bottom){
+    CHECK(result == BITMAP_ERROR_EMPTY_CROP);
+    CHECK(streamResult == BITMAP_ERROR_EMPTY_CROP);
+    return;
+  }
+  CHECK(result == BITMAP_SUCCESS && streamResult == BITMAP_SUCCESS);
+  CHECK(buffered.getWidth() == right - left && buffered.getHeight() == bottom - top);
+  CHECK(streamed.getWidth() == right - left && streamed.getHeight() == bottom - top);
+  if(buffered.getWidth() != right - left || buffered.getHeight() != bottom - top
+     || streamed.getWidth() != right - left || streamed.getHeight() != bottom - top)
+    return;
+
+  bool same = true;
+  for(int y = top; y < bottom; y++){
+    for(int x = left; x < right; x++){
+      Pixel expected = full.getPixel(x, y);
+      Pixel a = buffered.getPixel(x - left, y - top), b = streamed.getPixel(x - left, y - top);
+      if(memcmp(&a, &expected, sizeof(Pixel)) != 0 || memcmp(&b, &expected, sizeof(Pixel)) != 0)
+        same = false;
+    }
+  }
+  CHECK(same);
+}
+
+//windows inside the image, hanging off each side and missing it altogether, of every bit depth
+//top down and bottom up, and of RLE data.
+static void testDecodeRect()
+{
+  const int windows[][4] = { { 5, 3, 20, 11 }, { 0, 0, 77, 1 }, { 71, 40, 30, 30 }, { -9, -4, 16, 9 },
+                             { 3, 52, 9, 9 }, { 77, 0, 5, 5 }, { 0, -10, 5, 10 } };
+  for(int bitsPerPixel : { 1, 4, 8, 16, 24, 32 }){
+    for(int height : { 53, -53 }){
+      std::vector<uint8_t> file = randomFile(77, height, bitsPerPixel);
+      for(const int *window : windows){
+        checkDecodeRect<PixelRGB888>(file, window[0], window[1], window[2], window[3]);
+        checkDecodeRect<PixelRGB565>(file, window[0], window[1], window[2], window[3]);
+      }
+    }
+  }
+  RLEImage images[] = { rle8Image(), rle4Image() };
+  for(const RLEImage &image : images){
+    std::vector<uint8_t> file = rleFile(image);
+    checkDecodeRect<PixelRGB888>(file, 1, 1, 5, 2);
+    checkDecodeRect<PixelRGB888>(file, 4, 0, 9, 9);
+  }
+}
+
+//------------------------------------------------------------------ storage block
+
+//an allocator that counts what it hands out and gets back, and can be told to fail.
+struct CountingArena {
+  int allocs = 0;
+  int frees = 0;
+  size_t lastBytes = 0;
+  bool fail = false;
+};
+
+static void *arenaAlloc(size_t bytes, void *context)
+{
+  CountingArena *arena = (CountingArena *)context;
+  if(arena->fail)
+    return 0;
+  arena->allocs++;
+  arena->lastBytes = bytes;
+  return malloc(bytes);
+}
+
+static void arenaFree(void *block, void *context)
+{
+  ((CountingArena *)context)->frees++;
+  free(block);
+}
+
+//bitmap holds the pixels a fresh decode of file gives.
+template<class Format>
+static bool sameAsFresh(ESPBitmapT<Format> &bitmap, const std::vector<uint8_t> &file)
+{
+  ESPBitmapT<Format> fresh;
+  if(fresh.DecodeFileBuffer((uint8_t *)file.data(), file.size()) != BITMAP_SUCCESS)
+    return false;
+  if(bitmap.getWidth() != fresh.getWidth() || bitmap.getHeight() != fresh.getHeight())
+    return false;
+  for(int y = 0; y < fresh.getHeight(); y++){
+    for(int x = 0; x < fresh.getWidth(); x++){
+      typename Format::Pixel a = bitmap.getPixel(x, y), b = fresh.getPixel(x, y);
+      if(memcmp(&a, &b, sizeof(a)) != 0)
+        return false;
+    }
+  }
+  return true;
+}
+
+//images that fit the block already held are loaded into it without asking the allocator again, through
+//reset() too, and come out like a fresh decode. reset(false) and the destructor give the block back, and an
+//allocator with nothing to give fails the load as out of memory.
+template<class Format>
+static void checkReuse()
+{
+  std::vector<uint8_t> big = randomFile(64, 48, 24);
+  std::vector<uint8_t> smaller = randomFile(40, 30, 8);
+  std::vector<uint8_t> smallest = randomFile(17, 9, 4);
+  CountingArena arena;
+  {
+    ESPBitmapT<Format> bitmap;
+    bitmap.setAllocator(arenaAlloc, arenaFree, &arena);
+    CHECK(bitmap.DecodeFileBuffer(big.data(), big.size()) == BITMAP_SUCCESS);
+    CHECK(arena.allocs == 1 && bitmap.storageCapacity() == arena.lastBytes);
+    CHECK(sameAsFresh(bitmap, big));
+    size_t capacity = bitmap.storageCapacity();
+
+    CHECK(bitmap.DecodeFileBuffer(smaller.data(), smaller.size()) == BITMAP_SUCCESS);
+    CHECK(sameAsFresh(bitmap, smaller));
+    MemoryStream stream(smallest, 7);
+    CHECK(bitmap.getFromStream(&stream, smallest.size(), 1000) == BITMAP_SUCCESS);
+    CHECK(sameAsFresh(bitmap, smallest));
+    bitmap.reset();
+    CHECK(bitmap.getWidth() == 0 && bitmap.storageCapacity() == capacity);
+    CHECK(bitmap.DecodeFileBuffer(big.data(), big.size()) == BITMAP_SUCCESS);
+    CHECK(sameAsFresh(bitmap, big));
+    CHECK(arena.allocs == 1 && arena.frees == 0 && bitmap.storageCapacity() == capacity);
+
+    bitmap.reset(false);
+    CHECK(arena.frees == 1 && bitmap.storageCapacity() == 0);
+    arena.fail = true;
+    CHECK(bitmap.DecodeFileBuffer(smaller.data(), smaller.size()) == BITMAP_ERROR_OUT_OF_MEMORY);
+    arena.fail = false;
+    CHECK(bitmap.DecodeFileBuffer(smaller.data(), smaller.size()) == BITMAP_SUCCESS);
+    CHECK(sameAsFresh(bitmap, smaller));
+    CHECK(arena.allocs == 2);
+
+    //a bigger image than the block holds gets a new one in place of it.
+    CHECK(bitmap.DecodeFileBuffer(big.data(), big.size()) == BITMAP_SUCCESS);
+    CHECK(sameAsFresh(bitmap, big));
+    CHECK(arena.allocs == 3 && arena.frees == 2);
+  }
+  CHECK(arena.frees == arena.allocs);
+}
+
+static void testReuse()
+{
+  checkReuse<PixelRGB888>();
+  checkReuse<PixelRGB565>();
+}
+
+//------------------------------------------------------------------ copySpan
+
+//filling bursts of every size with copySpan walks the window in the order a panel takes it, each pixel the one
+//ESPBitmap16 has there, byte swapped for ESPBitmap16Swapped. pixels outside the image are left as they were.
+static void testCopySpan()
+{
+  for(int bitsPerPixel : { 4, 8, 24 }){
+    std::vector<uint8_t> file = randomFile(37, 21, bitsPerPixel);
+    ESPBitmap16 plain;
+    CHECK(plain.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+    ESPBitmap16Swapped swapped;
+    CHECK(swapped.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+
+    //a window inside the image and one hanging off its bottom right.
+    const int windows[][4] = { { 3, 2, 29, 17 }, { 30, 15, 12, 9 } };
+    for(const int *window : windows){
+      int x0 = window[0], y0 = window[1], w = window[2], h = window[3];
+      for(int burst : { 1, 7, 29, 64, 1000 }){
+        std::vector<uint16_t> span(burst), spanSwapped(burst);
+        bool same = true;
+        uint32_t pos = 0;
+        int bursts = 0;
+        while(true){
+          std::fill(span.begin(), span.end(), 0xA5A5);
+          std::fill(spanSwapped.begin(), spanSwapped.end(), 0xA5A5);
+          int n = plain.copySpan(x0, y0, w, h, pos, span.data(), burst);
+          if(swapped.copySpan(x0, y0, w, h, pos, spanSwapped.data(), burst) != n)
+            same = false;
+          if(n == 0)
+            break;
+          for(int i = 0; i < n; i++){
+            int x = x0 + (pos + i) % w, y = y0 + (pos + i) / w;
+            bool inside = x < plain.getWidth() && y < plain.getHeight();
+            uint16_t expected = inside ? plain.getPixel(x, y) : 0xA5A5;
+            uint16_t expectedSwapped = inside ? (uint16_t)(expected >> 8 | expected << 8) : 0xA5A5;
+            if(span[i] != expected || spanSwapped[i] != expectedSwapped || (inside && swapped.getPixel(x, y) != expectedSwapped))
+              same = false;
+          }
+          pos += n;
+          bursts++;
+        }
+        CHECK(same);
+        CHECK(pos == (uint32_t)(w * h));
+        CHECK(bursts == (w * h + burst - 1) / burst);
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------ setPipeline
+
+//getFromStream of file through a ring of chunks chunks of chunkBytes gives what a serial one does: the same
+//result, and when it loads, the same pixels. a file shorter than len only waits a moment for the rest.
+template<class Format>
+static bool samePipelined(const std::vector<uint8_t> &file, int len, int chunks, size_t chunkBytes, int targetWidth)
+{
+  ESPBitmapT<Format> serial, pipelined;
+  pipelined.setPipeline(chunks, chunkBytes);
+  ESPBitmapT<Format> *bitmaps[] = { &serial, &pipelined };
+  BITMAP_RESULT_t results[2];
+  for(int i = 0; i < 2; i++){
+    if(targetWidth > 0)
+      bitmaps[i]->setDecodeSize(targetWidth, 0);
+    MemoryStream stream(file, 7);
+    results[i] = bitmaps[i]->getFromStream(&stream, len, len == (int)file.size() ? 1000 : 50);
+  }
+  if(results[0] != results[1])
+    return false;
+  if(results[0] != BITMAP_SUCCESS)
+    return true;
+  if(serial.getWidth() != pipelined.getWidth() || serial.getHeight() != pipelined.getHeight())
+    return false;
+  std::vector<typename Format::Pixel> serialRow(serial.getWidth()), pipelinedRow(serial.getWidth());
+  for(int y = 0; y < serial.getHeight(); y++){
+    serial.copyRow(y, 0, serial.getWidth(), serialRow.data());
+    pipelined.copyRow(y, 0, serial.getWidth(), pipelinedRow.data());
+    if(memcmp(serialRow.data(), pipelinedRow.data(), serialRow.size() * sizeof(serialRow[0])) != 0)
+      return false;
+  }
+  return true;
+}
+
+//every bit depth, RLE and reduced images, rings big and small (wrapping around many times), and files cut
+//short, load the same pipelined as serially.
+static void testPipeline()
+{
+  for(int bitsPerPixel : { 1, 4, 8, 16, 24, 32 }){
+    std::vector<uint8_t> file = randomFile(101, 67, bitsPerPixel);
+    CHECK(samePipelined<PixelRGB888>(file, file.size(), 4, BITMAP_PIPELINE_CHUNK, 0));
+    CHECK(samePipelined<PixelRGB565>(file, file.size(), 4, BITMAP_PIPELINE_CHUNK, 0));
+    CHECK(samePipelined<PixelRGB565>(file, file.size(), 2, 16, 0));
+    CHECK(samePipelined<PixelRGB565>(file, file.size(), 3, 61, 37));
+    CHECK(samePipelined<PixelGray4>(file, file.size(), 2, 16, 0));
+
+    std::vector<uint8_t> cut(file.begin(), file.begin() + file.size() * 2 / 3);
+    CHECK(samePipelined<PixelRGB565>(cut, file.size(), 2, 16, 0));
+    CHECK(samePipelined<PixelRGB565>(cut, cut.size(), 2, 16, 0));
+    CHECK(samePipelined<PixelRGB565>(cut, -1, 2, 16, 0));
+  }
+  RLEImage images[] = { rle8Image(), rle4Image() };
+  for(const RLEImage &image : images){
+    std::vector<uint8_t> file = rleFile(image);
+    CHECK(samePipelined<PixelRGB888>(file, file.size(), 2, 16, 0));
+    CHECK(samePipelined<PixelRGB888>(file, file.size(), 2, 3, 0));
+  }
+}
+
+//------------------------------------------------------------------ setQuantize
+
+//bitmap holds the pixels of quantized, or what's left of them after 332 when rgb332 is set.
+template<class Format>
+static bool sameQuantized(ESPBitmapT<Format> &bitmap, ESPBitmap &plain, bool rgb332)
+{
+  if(bitmap.getWidth() != plain.getWidth() || bitmap.getHeight() != plain.getHeight())
+    return false;
+  for(int y = 0; y < plain.getHeight(); y++){
+    for(int x = 0; x < plain.getWidth(); x++){
+      PIXEL_t c = plain.getPixel(x, y);
+      typename Format::Pixel expected = rgb332 ? Format::fromRGBA((c.r >> 5) * 255 / 7, (c.g >> 5) * 255 / 7, (c.b >> 6) * 255 / 3, 0)
+                                               : Format::fromRGBA(c.r, c.g, c.b, 0);
+      typename Format::Pixel pixel = bitmap.getPixel(x, y);
+      if(memcmp(&pixel, &expected, sizeof(pixel)) != 0)
+        return false;
+    }
+  }
+  return true;
+}
+
+//332 is every pixel of the plain decode cut down to 3, 3 and 2 bits, from a buffer or a stream. a median cut
+//of an image of a few colors finds each of them exactly, streams fall back to 332, and setRepack shrinks it
+//further with the same pixels. either way the image takes a byte a pixel and the palette.
+template<class Format>
+static void checkQuantize(int bitsPerPixel)
+{
+  const int width = 161, height = 67;
+  std::vector<uint8_t> file = randomFile(width, height, bitsPerPixel);
+  ESPBitmap plain;
+  CHECK(plain.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+  size_t quantizedBytes = 4 * ((width + 3) / 4) * height + 256 * sizeof(typename Format::Pixel) + 256;
+
+  ESPBitmapT<Format> buffered, streamed;
+  buffered.setQuantize(BITMAP_QUANTIZE_332);
+  streamed.setQuantize(BITMAP_QUANTIZE_MEDIAN_CUT);
+  CHECK(buffered.DecodeFileBuffer(file.data(), file.size()) == BITMAP_SUCCESS);
+  MemoryStream stream(file, 7);
+  CHECK(streamed.getFromStream(&stream, file.size(), 1000) == BITMAP_SUCCESS);
+  CHECK(sameQuantized(buffered, plain, true));
+  CHECK(sameQuantized(streamed, plain, true));
+  CHECK(buffered.storageCapacity() <= quantizedBytes);
+
+  //16 colors, each channel a multiple of 17 so it fills one bin of the histogram.
+  uint8_t palette[16][3];
+  for(int i = 0; i < 16; i++)
+    for(int c = 0; c < 3; c++)
+      palette[i][c] = 17 * (randomByte() & 0x0F);
+  size_t scanlineWidth = 4 * ((width * bitsPerPixel + 31) / 32);
+  std::vector<uint8_t> pixels(scanlineWidth * height, 0);
+  for(int y = 0; y < height; y++){
+    for(int x = 0; x < width; x++){
+      const uint8_t *rgb = palette[randomByte() & 0x0F];
+      uint8_t *dst = &pixels[scanlineWidth * y + x * bitsPerPixel / 8];
+      if(bitsPerPixel == 16){
+        uint16_t p = (rgb[0] >> 3) << 10 | (rgb[1] >> 3) << 5 | (rgb[2] >> 3);
+        dst[0] = p;
+        dst[1] = p >> 8;
+      }
+      else {
+        dst[0] = rgb[2];
+        dst[1] = rgb[1];
+        dst[2] = rgb[0];
+      }
+    }
+  }
+  std::vector<uint8_t> fewFile = makeFile(width, height, bitsPerPixel, BI_UNCOMPRESSED, 40, 0, 0, pixels);
+  ESPBitmap fewPlain;
+  CHECK(fewPlain.DecodeFileBuffer(fewFile.data(), fewFile.size()) == BITMAP_SUCCESS);
+  ESPBitmapT<Format> cut, repacked;
+  cut.setQuantize(BITMAP_QUANTIZE_MEDIAN_CUT);
+  repacked.setQuantize(BITMAP_QUANTIZE_MEDIAN_CUT);
+  repacked.setRepack(true);
+  CHECK(cut.DecodeFileBuffer(fewFile.data(), fewFile.size()) == BITMAP_SUCCESS);
+  CHECK(repacked.DecodeFileBuffer(fewFile.data(), fewFile.size()) == BITMAP_SUCCESS);
+  //16bpp files are 555, whose 5 bits widened back aren't always a multiple of 17.
+  if(bitsPerPixel != 16)
+    CHECK(sameQuantized(cut, fewPlain, false));
+  CHECK(cut.storageCapacity() <= quantizedBytes);
+  CHECK(repacked.storageCapacity() < cut.storageCapacity());
+  bool same = true;
+  for(int y = 0; y < height; y++){
+    for(int x = 0; x < width; x++){
+      typename Format::Pixel a = cut.getPixel(x, y), b = repacked.getPixel(x, y);
+      if(memcmp(&a, &b, sizeof(a)) != 0)
+        same = false;
+    }
+  }
+  CHECK(same);
+}
+
+static void testQuantize()
+{
+  for(int bitsPerPixel : { 16, 24, 32 }){
+    checkQuantize<PixelRGB888>(bitsPerPixel);
+    checkQuantize<PixelRGB565>(bitsPerPixel);
+  }
+}
+
+//------------------------------------------------------------------ running them
+
+struct Test {
+  const char *name;
+  void (*run)();
+};
+
+static const Test tests[] = {
+  { "stream_decode", testStreamDecode },
+  { "file_source", testFileSource },
+  { "cache", testCache },
+  { "conditional_fetch", testConditionalFetch },
+  { "workers", testWorkers },
+  { "packed_palette", testPackedPalette },
+  { "premultiplied_alpha", testPremultipliedAlpha },
+  { "bad_headers", testBadHeaders },
+  { "short_palette", testShortPalette },
+  { "short_palette_repack", testShortPaletteRepack },
+  { "rle", testRLE },
+  { "copy_row", testCopyRow },
+  { "bitfields", testBitfields },
+  { "borrow", testBorrow },
+  { "convert_565", testConvert565 },
+  { "decode_size", testDecodeSize },
+  { "decode_rect", testDecodeRect },
+  { "reuse", testReuse },
+  { "copy_span", testCopySpan },
+  { "pipeline", testPipeline },
+  { "quantize", testQuantize },
+};
+
+int main(int argc, char **argv)
+{
+  int ran = 0;
+  for(const Test &test : tests){
+    bool wanted = argc < 2;
+    for(int i = 1; i < argc; i++)
+      if(strcmp(argv[i], test.name) == 0)
+        wanted = true;
+    if(!wanted)
+      continue;
+    int before = failures;
+    test.run();
+    printf("%-24s %s\n", test.name, failures == before ? "ok" : "FAILED");
+    ran++;
+  }
+  if(ran == 0){
+    printf("no test by that name\n");
+    return 1;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -22,31 +22,9 @@ THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef _ESPBITMAP32_H_
 #define _ESPBITMAP32_H_
 
-#include <inttypes.h>
-#include "ESPBitmapBase.h"
+#include "ESPBitmapT.h"
 
-class ESPBitmap : public ESPBitmapBase
-{
-  private:
-    PIXEL_t * palette = 0;
-
-    uint8_t * colorData = 0;
-    
-  public:
-    ESPBitmap();
-    ~ESPBitmap();
-
-    //decodes a bitmap from a buffer array. Expects entire file to be present in the byte array
-    BITMAP_RESULT_t DecodeFileBuffer(uint8_t *wholeFileBytes, int32_t length);
-
-    PIXEL_t getPixel(int x, int y);
-
-    PIXEL_t ERROR_COLOR;
-    
-#ifdef ESP8266
-  BITMAP_RESULT_t getFromStream(Stream* stream, int len, int timeoutMs);
-  //BITMAP_RESULT_t StreamDecode(Stream* stream, int len, int timeoutMs, void (*decodeCallBack)(BITMAP_RESULT_t, PIXEL_t, int, int));
-#endif //ESP8266
-};
+//32 bit PIXEL_t output with the alpha from the file, the pixel data is kept as it is in the file.
+typedef ESPBitmapT<PixelRGB888> ESPBitmap;
 
 #endif /*_ESPBITMAP32_H_*/
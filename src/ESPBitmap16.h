@@ -1,5 +1,5 @@
 /*
-ESPBitmap Library, 16 bit optimized version
+ESPBitmap Library
 Copyright 2018 Rickey Ward
 
 MIT License
@@ -22,30 +22,9 @@ THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef _ESPBITMAP16_H_
 #define _ESPBITMAP16_H_
 
-#include <inttypes.h>
-#include "ESPBitmapBase.h"
+#include "ESPBitmapT.h"
 
-class ESPBitmap16 : public ESPBitmapBase
-{
-  private:
-    uint16_t * palette = 0;
-    uint8_t * colorData = 0;
-    
-  public:
-    ESPBitmap16();
-    ~ESPBitmap16();
-
-    //decodes a bitmap from a buffer array.
-    //Expects entire file to be present in the byte array
-    BITMAP_RESULT_t DecodeFileBuffer(uint8_t *wholeFileBytes, int32_t length);
-
-    uint16_t getPixel(int x, int y);
-    uint16_t ERROR_COLOR;
-
-#ifdef ESP8266
-  BITMAP_RESULT_t getFromStream(Stream* stream, int len, int timeoutMs);
-  //BITMAP_RESULT_t StreamDecode(Stream* stream, int len, int timeoutMs, void (*decodeCallBack)(BITMAP_RESULT_t, uint16_t, int, int));
-#endif //ESP8266
-};
+//RGB565 output, 16, 24 and 32bpp images are converted when they load.
+typedef ESPBitmapT<PixelRGB565> ESPBitmap16;
 
 #endif /*_ESPBITMAP16_H_*/
@@ -21,16 +21,25 @@ THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <Arduino.h>
 #include <pins_arduino.h>
 #include "ESPBitmapBase.h"
+#ifdef ESPBITMAP_THREADS
+#include <thread>
+#endif
 
 #ifdef ESP8266
 #include <ESP8266HTTPClient.h>
 #include <stream.h>
+#include <atomic>
+#include "ESPBitmapTransport.h"
 #endif
 
-//TODO, for 16 color mode, we need to create a colorData16 array, and proccess all the pixels into that (only for 24 bit)
-
-#define DEBUG
-#define DEBUG_FINE
+//Serial debug output is compiled out unless ESPBITMAP_DEBUG is defined when building the library,
+//ESPBITMAP_DEBUG_FINE adds the very chatty per chunk output of the stream parsers.
+#ifdef ESPBITMAP_DEBUG
+ #define DEBUG
+#endif
+#ifdef ESPBITMAP_DEBUG_FINE
+ #define DEBUG_FINE
+#endif
 //#define FAST_AND_LOOSE  //skip some error checking and risk undesirable behavior for speed.
 
 #ifdef DEBUG
@@ -51,25 +60,485 @@ THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #ifdef ESP8266
 BITMAP_RESULT_t ESPBitmapBase::fetchImageFromUrl(String imageUrl){
-  fetchImageFromUrl(imageUrl, 5000);
+  return fetchImageFromUrl(imageUrl, 5000);
 }
 
 BITMAP_RESULT_t ESPBitmapBase::fetchImageFromUrl(String imageUrl, int timeoutMs){
-  HTTPClient http;
-  http.begin(imageUrl);
-  int httpCode = http.GET();
+  ESPBitmapHTTPTransport http;
+  ESPBitmapTransport *client = transport != 0 ? transport : &http;
+  //the image we hold came from this url, so the server only has to send it again if it changed.
+  bool conditional = fetchedUrl.length() > 0 && imageUrl == fetchedUrl;
+  fetchNotModified = false;
+  int httpCode = client->get(imageUrl, conditional ? fetchedETag : String(), conditional ? fetchedLastModified : String());
   DEBUG_PRINTLN("[HTTP] GET..." + imageUrl);
-  if (httpCode > 0) {
-    DEBUG_PRINT(F("[HTTP] RETURN CODE WAS: "));
-    DEBUG_PRINTLN(httpCode);
-    if (httpCode == HTTP_CODE_OK) {
-      return getFromStream(http.getStreamPtr(), http.getSize(), timeoutMs);
-    }//END OK
-  }//EMD CODE>0
-  return BITMAP_ERROR_FETCH_FAILED;
+  DEBUG_PRINT(F("[HTTP] RETURN CODE WAS: "));
+  DEBUG_PRINTLN(httpCode);
+
+  BITMAP_RESULT_t result = BITMAP_ERROR_FETCH_FAILED;
+  if (httpCode == HTTP_CODE_NOT_MODIFIED && conditional) {
+    fetchNotModified = true;
+    result = BITMAP_SUCCESS;
+  }
+  else if (httpCode == HTTP_CODE_OK) {
+    //loading clears what we knew about the old image, so the new validators are kept aside until it's in.
+    String etag = client->etag();
+    String lastModified = client->lastModified();
+    result = getFromStream(client->stream(), client->size(), timeoutMs);
+    if (result == BITMAP_SUCCESS) {
+      fetchedUrl = imageUrl;
+      fetchedETag = etag;
+      fetchedLastModified = lastModified;
+    }
+  }
+  client->end();
+  return result;
+}
+
+void ESPBitmapBase::setTransport(ESPBitmapTransport *client){
+  transport = client;
+}
+
+BITMAP_RESULT_t ESPBitmapBase::getFromStream(Stream* stream, int len, int timeoutMs){
+  if(pipelineChunks >= 2 && runner() != 0)
+    return pipelineFromStream(stream, len, timeoutMs);
+
+  unsigned long startMs = millis();
+  BITMAP_RESULT_t result = beginStream(stream, len);
+  while(result == BITMAP_IN_PROGRESS){
+    if(millis() - startMs >= (unsigned long)timeoutMs){
+      cancelStream();
+      return BITMAP_ERROR_FETCH_FAILED;
+    }
+    if(stream->available() == 0){
+      BITMAP_STAT(uint32_t stallStart = micros());
+      delay(1);
+      BITMAP_STAT(stats.stallMicros += micros() - stallStart);
+    }
+    else
+      yield();
+    result = poll();
+  }
+  return result;
+}
+
+BITMAP_RESULT_t ESPBitmapBase::beginStream(Stream* stream, int len){
+  BITMAP_RESULT_t result = beginLoad(len);
+  if(result != BITMAP_SUCCESS)
+    return result;
+  loadStream = stream;
+  loadRemaining = len;
+  return BITMAP_IN_PROGRESS;
+}
+
+BITMAP_RESULT_t ESPBitmapBase::poll(){
+  if(loadStream == 0 || load == 0)
+    return BITMAP_ERROR_FETCH_FAILED;
+
+  //take in whatever has arrived (up to BITMAP_POLL_BYTES) a buffer at a time, and parse it out of memory.
+  uint8_t buffer[BITMAP_STREAM_BUFFER_SIZE];
+  size_t budget = BITMAP_POLL_BYTES;
+  BITMAP_RESULT_t result = BITMAP_SUCCESS;
+  BITMAP_STAT(if(loadStream->available() == 0) stats.stalls++);
+  while(result == BITMAP_SUCCESS && !load->finished && loadRemaining != 0 && budget > 0){
+    size_t size = loadStream->available();
+    if(size > sizeof(buffer))
+      size = sizeof(buffer);
+    if(size > budget)
+      size = budget;
+    if(loadRemaining > 0 && size > (size_t)loadRemaining)
+      size = loadRemaining;
+    if(size == 0)
+      break;
+
+    size_t c = loadStream->readBytes(buffer, size);
+    BITMAP_STAT(stats.readCalls++);
+    BITMAP_STAT(stats.bytesRead += c);
+    if(c == 0)
+      break;
+    if(loadRemaining > 0)
+      loadRemaining -= c;
+    budget -= c;
+    result = feedLoad(buffer, c);
+  }
+
+  if(result != BITMAP_SUCCESS){
+    cancelStream();
+    return result;
+  }
+  //done, or the stream ended and endLoad decides if what we got is enough.
+  if(load->finished || loadRemaining == 0){
+    loadStream = 0;
+    return endLoad();
+  }
+  DEBUG_FINE_PRINT(F("WAITING FOR STREAM. Offset Currently: "));
+  DEBUG_FINE_PRINTLN(load->offset);
+  return BITMAP_IN_PROGRESS;
+}
+
+void ESPBitmapBase::cancelStream(){
+  loadStream = 0;
+  releaseLoad();
+}
+
+void ESPBitmapBase::setPipeline(int chunks, size_t chunkBytes){
+  pipelineChunks = chunks;
+  pipelineChunkBytes = chunkBytes > 0 ? chunkBytes : BITMAP_PIPELINE_CHUNK;
+}
+
+//the ring between getFromStream's reader (worker 1) and decoder (worker 0). each side only ever moves its own count
+//on, the reader fills chunks and the decoder empties them, so a chunk never has both working on it.
+struct ESPBitmapBase::PipelineState {
+  ESPBitmapBase *bitmap;
+  Stream *stream;
+  int remaining;            //bytes of the stream left to read, -1 if unknown
+  unsigned long startMs;
+  int timeoutMs;
+  uint8_t *ring;
+  size_t *lengths;          //bytes in each chunk
+  size_t chunkBytes;
+  uint32_t chunks;
+  std::atomic<uint32_t> filled;   //chunks the reader has filled so far
+  std::atomic<uint32_t> emptied;  //and the decoder has emptied
+  std::atomic<bool> readerDone;   //the stream ended, or timed out
+  std::atomic<bool> decoderDone;  //the image is in, or failed
+  bool timedOut;
+  BITMAP_RESULT_t result;
+  uint32_t readCalls;
+  uint32_t bytesRead;
+  uint32_t stalls;
+  uint32_t stallMicros;
+};
+
+void ESPBitmapBase::pipelineJob(void *arg, int worker){
+  PipelineState &pipe = *(PipelineState *)arg;
+
+  //the reader, it waits for room in the ring and for the stream, never for the decoder to finish a chunk.
+  if(worker == 1){
+    while(!pipe.decoderDone.load(std::memory_order_acquire) && pipe.remaining != 0){
+      if(millis() - pipe.startMs >= (unsigned long)pipe.timeoutMs){
+        pipe.timedOut = true;
+        break;
+      }
+      uint32_t filled = pipe.filled.load(std::memory_order_relaxed);
+      if(filled - pipe.emptied.load(std::memory_order_acquire) == pipe.chunks){
+        yield();
+        continue;
+      }
+      size_t size = pipe.stream->available();
+      if(size > pipe.chunkBytes)
+        size = pipe.chunkBytes;
+      if(pipe.remaining > 0 && size > (size_t)pipe.remaining)
+        size = pipe.remaining;
+      if(size == 0){
+        uint32_t stallStart = micros();
+        pipe.stalls++;
+        delay(1);
+        pipe.stallMicros += micros() - stallStart;
+        continue;
+      }
+
+      uint32_t slot = filled % pipe.chunks;
+      size_t c = pipe.stream->readBytes(pipe.ring + slot * pipe.chunkBytes, size);
+      pipe.readCalls++;
+      pipe.bytesRead += c;
+      if(c == 0)
+        continue;
+      if(pipe.remaining > 0)
+        pipe.remaining -= c;
+      pipe.lengths[slot] = c;
+      pipe.filled.store(filled + 1, std::memory_order_release);
+    }
+    pipe.readerDone.store(true, std::memory_order_release);
+    return;
+  }
+
+  //the decoder parses the chunks in order until the image is in, or the reader is done and the ring is empty.
+  ESPBitmapBase &bitmap = *pipe.bitmap;
+  uint32_t emptied = 0;
+  while(pipe.result == BITMAP_SUCCESS && !bitmap.load->finished){
+    if(emptied == pipe.filled.load(std::memory_order_acquire)){
+      if(pipe.readerDone.load(std::memory_order_acquire) && emptied == pipe.filled.load(std::memory_order_acquire))
+        break;
+      yield();
+      continue;
+    }
+    uint32_t slot = emptied % pipe.chunks;
+    pipe.result = bitmap.feedLoad(pipe.ring + slot * pipe.chunkBytes, pipe.lengths[slot]);
+    pipe.emptied.store(++emptied, std::memory_order_release);
+  }
+  pipe.decoderDone.store(true, std::memory_order_release);
+}
+
+BITMAP_RESULT_t ESPBitmapBase::pipelineFromStream(Stream* stream, int len, int timeoutMs){
+  BITMAP_RESULT_t result = beginLoad(len);
+  if(result != BITMAP_SUCCESS)
+    return result;
+
+  PipelineState pipe;
+  pipe.bitmap = this;
+  pipe.stream = stream;
+  pipe.remaining = len;
+  pipe.startMs = millis();
+  pipe.timeoutMs = timeoutMs;
+  pipe.chunkBytes = pipelineChunkBytes;
+  pipe.chunks = pipelineChunks;
+  pipe.ring = new uint8_t[pipe.chunks * pipe.chunkBytes];
+  pipe.lengths = new size_t[pipe.chunks];
+  pipe.filled.store(0);
+  pipe.emptied.store(0);
+  pipe.readerDone.store(false);
+  pipe.decoderDone.store(false);
+  pipe.timedOut = false;
+  pipe.result = BITMAP_SUCCESS;
+  pipe.readCalls = pipe.bytesRead = pipe.stalls = pipe.stallMicros = 0;
+  size_t ringBytes = pipe.chunks * (pipe.chunkBytes + sizeof(size_t));
+
+  if(pipe.ring == 0 || pipe.lengths == 0)
+    result = BITMAP_ERROR_OUT_OF_MEMORY;
+  else{
+    BITMAP_STAT(statAllocated(ringBytes));
+    runner()(pipelineJob, &pipe, 2, workerContext);
+    BITMAP_STAT(statFreed(ringBytes));
+    BITMAP_STAT(stats.readCalls += pipe.readCalls);
+    BITMAP_STAT(stats.bytesRead += pipe.bytesRead);
+    BITMAP_STAT(stats.stalls += pipe.stalls);
+    BITMAP_STAT(stats.stallMicros += pipe.stallMicros);
+    result = pipe.result;
+  }
+  if(pipe.ring != 0)
+    delete[] pipe.ring;
+  if(pipe.lengths != 0)
+    delete[] pipe.lengths;
+
+  //like poll(), a stream that ended early leaves it to endLoad to decide if what we got is enough.
+  if(result == BITMAP_SUCCESS && !load->finished && (pipe.timedOut || pipe.remaining != 0))
+    result = BITMAP_ERROR_FETCH_FAILED;
+  if(result != BITMAP_SUCCESS){
+    releaseLoad();
+    return result;
+  }
+  return endLoad();
 }
 #endif
 
+BITMAP_RESULT_t ESPBitmapBase::beginLoad(int32_t length)
+{
+    reset();
+    BITMAP_STAT(resetStats());
+    load = new LoadState();
+    if(load == 0)
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    load->length = length;
+    BITMAP_STAT(statAllocated(sizeof(LoadState)));
+    return BITMAP_SUCCESS;
+}
+
+BITMAP_RESULT_t ESPBitmapBase::feedLoad(const uint8_t *data, size_t count)
+{
+    LoadState &state = *load;
+    while(count > 0 && !state.finished){
+      size_t n;
+
+      //file and info header, they're parsed once all 54 bytes are in.
+      if(state.offset < BITMAP_MASKS_OFFSET){
+        n = BITMAP_MASKS_OFFSET - state.offset;
+        if(n > count)
+          n = count;
+        memcpy(state.headers + state.offset, data, n);
+        state.offset += n;
+        data += n;
+        count -= n;
+        if(state.offset < BITMAP_MASKS_OFFSET)
+          break;
+
+        BITMAP_FILE_HEADER_t bitmapHeader;
+        BITMAP_INFO_HEADER_t bitmapInfo;
+        memcpy(&bitmapHeader, state.headers, sizeof(BITMAP_FILE_HEADER_t));
+        memcpy(&bitmapInfo, state.headers + sizeof(BITMAP_FILE_HEADER_t), sizeof(BITMAP_INFO_HEADER_t));
+        BITMAP_RESULT_t headerResult = parseHeaders(bitmapHeader, bitmapInfo, state.colorsToLoad);
+        if(headerResult != BITMAP_SUCCESS)
+          return headerResult;
+        BITMAP_STAT(statPhase(stats.headerMicros));
+
+        state.maskLength = maskBytes(bitmapInfo);
+        state.paletteOffset = sizeof(BITMAP_FILE_HEADER_t) + bitmapInfo.headerSize;
+        //masks and palette have to come before the pixel data.
+        if(BITMAP_MASKS_OFFSET + state.maskLength > (size_t)dataOffset
+           || state.paletteOffset + state.colorsToLoad * 4 > (size_t)dataOffset)
+          return BITMAP_ERROR_TOO_SHORT;
+
+        //uncompressed images need exactly their rows, RLE data is as long as the file says.
+        BITMAP_RESULT_t lengthResult = findPixelLength(bitmapHeader, bitmapInfo, state.length, state.pixelLength);
+        if(lengthResult != BITMAP_SUCCESS)
+          return lengthResult;
+        data_length = state.pixelLength;
+
+        //images with bitfield masks wait for them.
+        if(state.maskLength == 0){
+          BITMAP_RESULT_t imageResult = startLoadImage();
+          if(imageResult != BITMAP_SUCCESS)
+            return imageResult;
+        }
+      }
+      //bitfield masks, the palette, and anything else before the pixel data (a bigger info header or a gap).
+      else if(state.offset < (size_t)dataOffset){
+        n = dataOffset - state.offset;
+        if(n > count)
+          n = count;
+        size_t paletteEnd = state.paletteOffset + state.colorsToLoad * 4;
+        for(size_t i = 0; i < n; i++){
+          size_t offset = state.offset + i;
+          if(offset - BITMAP_MASKS_OFFSET < state.maskLength){
+            state.masks[offset - BITMAP_MASKS_OFFSET] = data[i];
+            if(offset + 1 == BITMAP_MASKS_OFFSET + state.maskLength){
+              loadChannelMasks(state.masks, state.maskLength);
+              BITMAP_RESULT_t imageResult = startLoadImage();
+              if(imageResult != BITMAP_SUCCESS)
+                return imageResult;
+            }
+          }
+          else if(offset >= state.paletteOffset && offset < paletteEnd){
+            size_t entryByte = (offset - state.paletteOffset) & 3;
+            state.paletteEntry[entryByte] = data[i];
+            if(entryByte == 3)
+              setPaletteColor((offset - state.paletteOffset) >> 2, state.paletteEntry);
+          }
+        }
+        state.offset += n;
+        data += n;
+        count -= n;
+      }
+      //pixel data.
+      else{
+        size_t received = state.offset - dataOffset;
+        BITMAP_STAT(if(received == 0) statPhase(stats.paletteMicros));
+        n = state.pixelLength - received;
+        if(n > count)
+          n = count;
+        storePixelData(data, received, n);
+        state.offset += n;
+        data += n;
+        count -= n;
+        if(received + n == state.pixelLength)
+          state.finished = true;
+      }
+    }
+    return BITMAP_SUCCESS;
+}
+
+BITMAP_RESULT_t ESPBitmapBase::startLoadImage()
+{
+    LoadState &state = *load;
+    BITMAP_RESULT_t imageResult = beginImage(state.colorsToLoad, state.pixelLength, false);
+    if(imageResult != BITMAP_SUCCESS)
+      return imageResult;
+    if(state.colorsToLoad > 0){
+      BITMAP_RESULT_t paletteResult = allocatePalette(state.colorsToLoad);
+      if(paletteResult != BITMAP_SUCCESS)
+        return paletteResult;
+    }
+    return beginPixelData(state.pixelLength);
+}
+
+BITMAP_RESULT_t ESPBitmapBase::endLoad()
+{
+    BITMAP_RESULT_t result = BITMAP_ERROR_TOO_SHORT;
+    if(load->finished)
+      result = endPixelData(load->pixelLength);
+    else if(isRLE() && load->offset > (size_t)dataOffset && load->offset > BITMAP_MASKS_OFFSET)
+      result = endPixelData(load->offset - dataOffset);
+    BITMAP_STAT(statPhase(stats.dataMicros));
+
+    releaseLoad();
+    return result;
+}
+
+void ESPBitmapBase::releaseLoad()
+{
+    if(load != 0){
+      if(load->compressed != 0){
+        delete[] load->compressed;
+        BITMAP_STAT(statFreed(load->pixelLength));
+      }
+      delete load;
+      BITMAP_STAT(statFreed(sizeof(LoadState)));
+    }
+    load = 0;
+    releaseScale();
+}
+
+BITMAP_RESULT_t ESPBitmapBase::beginPixelData(size_t length)
+{
+    //uncompressed rows being reduced go straight to scaleRow.
+    if(scale != 0 && !isRLE())
+      return BITMAP_SUCCESS;
+
+    //RLE data that gets expanded or reduced is only needed until it's all in.
+    if(isRLE() && (scale != 0 || !keepCompressed)){
+      load->compressed = new uint8_t[length];
+      if(load->compressed == 0)
+        return BITMAP_ERROR_OUT_OF_MEMORY;
+      BITMAP_STAT(statAllocated(length));
+      return BITMAP_SUCCESS;
+    }
+
+    colorData = (uint8_t *)takeStorage(length);
+    if(colorData == 0)
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    return BITMAP_SUCCESS;
+}
+
+void ESPBitmapBase::storePixelData(const uint8_t *data, size_t offset, size_t count)
+{
+    if(load->compressed != 0){
+      memcpy(load->compressed + offset, data, count);
+      return;
+    }
+    if(scale == 0){
+      memcpy(colorData + offset, data, count);
+      return;
+    }
+
+    //whole scanlines are reduced straight out of data, the pieces around them are gathered in sourceRow first.
+    //rows outside the window are only counted.
+    ScaleState &state = *scale;
+    while(count > 0){
+      if(state.sourceFill == 0 && count >= scanlineWidth){
+        scaleRow(data);
+        data += scanlineWidth;
+        count -= scanlineWidth;
+        continue;
+      }
+      size_t n = scanlineWidth - state.sourceFill;
+      if(n > count)
+        n = count;
+      int32_t windowRow = state.sourceRows - state.firstRow;
+      if(windowRow >= 0 && windowRow < state.sourceHeight)
+        memcpy(state.sourceRow + state.sourceFill, data, n);
+      state.sourceFill += n;
+      data += n;
+      count -= n;
+      if(state.sourceFill == scanlineWidth){
+        scaleRow(state.sourceRow);
+        state.sourceFill = 0;
+      }
+    }
+}
+
+BITMAP_RESULT_t ESPBitmapBase::endPixelData(size_t length)
+{
+    if(scale != 0){
+      if(isRLE())
+        scaleRLE(load->compressed, length);
+      return endScale();
+    }
+
+    //RLE data has been read as is, now it gets expanded or indexed.
+    if(isRLE())
+      return storeRLE(load->compressed != 0 ? load->compressed : colorData, length);
+    return BITMAP_SUCCESS;
+}
+
 void ESPBitmapBase::printResult(BITMAP_RESULT_t errCode){
   Serial.print(F("ESPBitmap Result: "));
   switch(errCode){
@@ -78,13 +547,1108 @@ void ESPBitmapBase::printResult(BITMAP_RESULT_t errCode){
     case BITMAP_ERROR_TOO_SHORT: Serial.println(F("Too Short, not enough bytes supplied to be a bitmap")); break;
     case BITMAP_ERROR_INVALID_FHEADER: Serial.println(F("Invalid file header (first 14 bytes)")); break;
     case BITMAP_ERROR_INVALID_IHEADER: Serial.println(F("Invalid bitmap info header (bytes 15 to 54")); break;
-    case BITMAP_ERROR_UNSUPPORTED_BITDEPTH: Serial.println(F("Unsupported bit depth, only 1, 4, 8, 24 supported.")); break;
+    case BITMAP_ERROR_UNSUPPORTED_BITDEPTH: Serial.println(F("Unsupported bit depth, only 1, 4, 8, 16, 24, 32 supported.")); break;
     case BITMAP_ERROR_OUT_OF_MEMORY: Serial.println(F("Out of memory- failed allocation")); break;
     case BITMAP_ERROR_FETCH_FAILED: Serial.println(F("http fetch failed,")); break;
+    case BITMAP_IN_PROGRESS: Serial.println(F("In progress, keep calling poll()")); break;
+    case BITMAP_ERROR_EMPTY_CROP: Serial.println(F("Decode rect is outside the image")); break;
     default: Serial.println(F("UNKNOWN")); break;
   }
 }
 
+BITMAP_RESULT_t ESPBitmapBase::parseHeaders(BITMAP_FILE_HEADER_t &bitmapHeader, BITMAP_INFO_HEADER_t &bitmapInfo, size_t &colorsToLoad)
+{
+    DEBUG_PRINT(F("HeaderKey: "));
+    DEBUG_PRINTLN(bitmapHeader.headerKey);
+    DEBUG_PRINT(F("FileSize: "));
+    DEBUG_PRINTLN(bitmapHeader.filesize);
+    DEBUG_PRINT(F("data offset: "));
+    DEBUG_PRINTLN(bitmapHeader.dataOffset);
+
+    //bitmap header MUST start with 'BM' in ASCII 
+    if(bitmapHeader.headerKey != 0x4D42)
+      return BITMAP_ERROR_INVALID_FHEADER;
+
+    //dataOffset is kept signed and compared against lengths, one past INT32_MAX would come out negative.
+    if(bitmapHeader.dataOffset > INT32_MAX)
+      return BITMAP_ERROR_INVALID_FHEADER;
+    dataOffset = bitmapHeader.dataOffset;
+
+    DEBUG_PRINT("headersize: ");
+    DEBUG_PRINTLN(bitmapInfo.headerSize);
+    DEBUG_PRINT("width: ");
+    DEBUG_PRINTLN(bitmapInfo.width);
+    DEBUG_PRINT("height: ");
+    DEBUG_PRINTLN(bitmapInfo.height);
+    DEBUG_PRINT("Planes: ");
+    DEBUG_PRINTLN(bitmapInfo.planes);
+    DEBUG_PRINT("BitsPerPixel: ");
+    DEBUG_PRINTLN(bitmapInfo.bitsPerPixel);
+    DEBUG_PRINT("DataSize: ");
+    DEBUG_PRINTLN(bitmapInfo.dataSize);
+    DEBUG_PRINT("Compression: ");
+    DEBUG_PRINTLN(bitmapInfo.compression);
+    DEBUG_PRINT("colorsUsed: ");
+    DEBUG_PRINTLN(bitmapInfo.colorsUsed);
+    DEBUG_PRINT("importantColors: ");
+    DEBUG_PRINTLN(bitmapInfo.importantColors);
+
+    //bitmap header must at least be 40 for a windows compatibile bitmap image. OS/2 bitmaps are 12
+    //planes must always be 1 (this is a furture proofing property that was never realized.)
+    if(bitmapInfo.headerSize < 40 || bitmapInfo.planes != 1)
+      return BITMAP_ERROR_INVALID_IHEADER;
+
+    //an image has to have pixels, and its padded scanline width and row count have to fit an int.
+    if(bitmapInfo.width <= 0 || bitmapInfo.width > (INT32_MAX - 31) / 32 || bitmapInfo.height == 0 || bitmapInfo.height == INT32_MIN)
+      return BITMAP_ERROR_INVALID_IHEADER;
+
+    //RLE8 only goes with 8bpp, RLE4 with 4bpp and bitfields with 16 and 32bpp, nothing else is supported.
+    if(!(bitmapInfo.compression == BI_UNCOMPRESSED
+         || (bitmapInfo.compression == BI_RLE_8 && bitmapInfo.bitsPerPixel == 8)
+         || (bitmapInfo.compression == BI_RLE_4 && bitmapInfo.bitsPerPixel == 4)
+         || (bitmapInfo.compression == BI_BITFIELDS && (bitmapInfo.bitsPerPixel == 16 || bitmapInfo.bitsPerPixel == 32))))
+      return BITMAP_ERROR_UNSUPPORTED_COMPRESSION;
+
+    //a new image, so the row table of the last one doesn't apply anymore.
+    releaseRLE();
+    compression = bitmapInfo.compression;
+
+    width = bitmapInfo.width;
+    height = bitmapInfo.height;
+
+    // if height is negeative, then the image is stored flipped vertically
+    // normal bitmap is bottom to top left to right, flipped is top to bottom left to right
+    flipped = false;
+    if(height < 0) {
+      flipped = true;
+      height *= -1;
+    }
+
+    bitsPerPixel = bitmapInfo.bitsPerPixel;
+
+    //based on the bit depth, we may or may not need to load the palette.
+    switch (bitsPerPixel) {
+      case 1: colorsToLoad = (bitmapInfo.colorsUsed == 0 || bitmapInfo.colorsUsed > 2) ? 2 : bitmapInfo.colorsUsed; break;
+      case 4: colorsToLoad = (bitmapInfo.colorsUsed == 0 || bitmapInfo.colorsUsed > 16) ? 16 : bitmapInfo.colorsUsed; break;
+      case 8: colorsToLoad = (bitmapInfo.colorsUsed == 0 || bitmapInfo.colorsUsed > 256) ? 256 : bitmapInfo.colorsUsed; break;
+      case 24: colorsToLoad = 0; break;
+      //uncompressed 16 and 32bpp have fixed layouts, bitfield masks are loaded from the file afterwards.
+      case 16: colorsToLoad = 0; setChannelMasks(0x7C00, 0x03E0, 0x001F, 0); break;
+      case 32: colorsToLoad = 0; setChannelMasks(0x00FF0000, 0x0000FF00, 0x000000FF, 0); break;
+      default: return BITMAP_ERROR_UNSUPPORTED_BITDEPTH; break;
+    }
+
+    //for some strange reason bitmap scanlines are padded if need be to a 4-byte boundary, unused padding bytes full of 0s
+    scanlineWidth = 4 * ((int)( ((width * bitsPerPixel) + 31) / 32));
+
+    //all the rows together have to fit an int32_t too, or sizes and row offsets wrap (size_t is 32 bits on the ESP).
+    if((uint64_t)scanlineWidth * height > INT32_MAX)
+      return BITMAP_ERROR_INVALID_IHEADER;
+
+    return BITMAP_SUCCESS;
+}
+
+BITMAP_RESULT_t ESPBitmapBase::parseFileBuffer(const uint8_t *wholeFileBytes, int32_t length, BITMAP_FILE_HEADER_t &bitmapHeader, BITMAP_INFO_HEADER_t &bitmapInfo, size_t &colorsToLoad)
+{
+    // make sure the buffer comming in is big enough to actually contain a bitmap header.
+    if(length < (int32_t)(sizeof(BITMAP_FILE_HEADER_t) + sizeof(BITMAP_INFO_HEADER_t)))
+      return BITMAP_ERROR_TOO_SHORT;
+
+    //get header
+    memcpy(&bitmapHeader, wholeFileBytes, sizeof(BITMAP_FILE_HEADER_t));
+
+    //get bitmap info
+    memcpy(&bitmapInfo, wholeFileBytes + sizeof(BITMAP_FILE_HEADER_t), sizeof(BITMAP_INFO_HEADER_t));
+
+    //validate the headers and pull out the image properties.
+    BITMAP_RESULT_t result = parseHeaders(bitmapHeader, bitmapInfo, colorsToLoad);
+    if(result != BITMAP_SUCCESS)
+      return result;
+
+    //bitfield masks follow the first 40 bytes of the info header.
+    size_t maskLength = maskBytes(bitmapInfo);
+    if(maskLength > 0){
+      if(BITMAP_MASKS_OFFSET + maskLength > (size_t)length)
+        return BITMAP_ERROR_TOO_SHORT;
+      loadChannelMasks(wholeFileBytes + BITMAP_MASKS_OFFSET, maskLength);
+    }
+
+    //the palette has to come before the pixel data, and that has to start inside the buffer.
+    if(sizeof(BITMAP_FILE_HEADER_t) + bitmapInfo.headerSize + colorsToLoad * 4 > (size_t)dataOffset || dataOffset > length)
+      return BITMAP_ERROR_TOO_SHORT;
+
+    //uncompressed images are exactly their rows, RLE data is as long as the file says but never past the buffer.
+    return findPixelLength(bitmapHeader, bitmapInfo, length, data_length);
+}
+
+BITMAP_RESULT_t ESPBitmapBase::findPixelLength(BITMAP_FILE_HEADER_t &bitmapHeader, BITMAP_INFO_HEADER_t &bitmapInfo, int32_t length, size_t &pixelLength)
+{
+    //uncompressed images need every row, known to be missing before anything is reserved for them.
+    if(!isRLE()){
+      pixelLength = scanlineWidth * height;
+      if(length >= 0 && (dataOffset > length || pixelLength > (size_t)(length - dataOffset)))
+        return BITMAP_ERROR_TOO_SHORT;
+      return BITMAP_SUCCESS;
+    }
+
+    pixelLength = bitmapInfo.dataSize;
+    if(pixelLength == 0){
+      if(bitmapHeader.filesize < dataOffset)
+        return BITMAP_ERROR_TOO_SHORT;
+      pixelLength = bitmapHeader.filesize - dataOffset;
+    }
+    if(length >= 0){
+      if(dataOffset > length)
+        return BITMAP_ERROR_TOO_SHORT;
+      if(pixelLength > (size_t)(length - dataOffset))
+        pixelLength = length - dataOffset;
+    }
+    //every 2 bytes of RLE data make at least one pixel or end a row, anything past that is never decoded.
+    uint64_t most = 2 * ((uint64_t)width * height + height) + 2;
+    if(pixelLength > most)
+      pixelLength = most;
+    return BITMAP_SUCCESS;
+}
+
+size_t ESPBitmapBase::maskBytes(BITMAP_INFO_HEADER_t &bitmapInfo)
+{
+    if(bitmapInfo.compression != BI_BITFIELDS)
+      return 0;
+    //V3 and newer headers (56+ bytes) also carry an alpha mask.
+    return bitmapInfo.headerSize >= 56 ? 16 : 12;
+}
+
+void ESPBitmapBase::loadChannelMasks(const uint8_t *masks, size_t count)
+{
+    uint32_t m[4] = {0, 0, 0, 0};
+    for(size_t i = 0; i < count && i < 16; i++)
+      m[i >> 2] |= (uint32_t)masks[i] << (8 * (i & 3));
+    setChannelMasks(m[0], m[1], m[2], m[3]);
+}
+
+void ESPBitmapBase::setChannelMasks(uint32_t red, uint32_t green, uint32_t blue, uint32_t alpha)
+{
+    uint32_t masks[4] = {red, green, blue, alpha};
+    for(int i = 0; i < 4; i++){
+      BITMAP_CHANNEL_t &channel = channels[i];
+      channel.mask = masks[i];
+
+      //find the lowest bit and the width of the channel.
+      uint8_t low = 0;
+      uint8_t bits = 0;
+      if(masks[i] != 0){
+        while(!(masks[i] & (1UL << low)))
+          low++;
+        while(low + bits < 32 && (masks[i] & (1UL << (low + bits))))
+          bits++;
+      }
+
+      //line the top bit up with bit 7, dropping anything past 8 bits.
+      uint8_t top = low + bits;
+      channel.rightShift = top > 8 ? top - 8 : 0;
+      channel.leftShift = top < 8 ? 8 - top : 0;
+      if(bits == 0){
+        channel.rightShift = 0;
+        channel.leftShift = 0;
+      }
+      channel.replicate1 = (bits > 0 && bits < 8) ? bits : 0;
+      channel.replicate2 = (bits > 0 && bits < 4) ? bits * 2 : 0;
+    }
+
+    rgb565 = bitsPerPixel == 16 && red == 0xF800 && green == 0x07E0 && blue == 0x001F;
+}
+
+BITMAP_RESULT_t ESPBitmapBase::storeFileData(uint8_t *wholeFileBytes, int32_t length)
+{
+    //RLE data is expanded or indexed, parseFileBuffer already cut it off at the end of the buffer.
+    if(isRLE())
+      return storeRLE(wholeFileBytes + dataOffset, data_length);
+
+    //every row has to be in the buffer, whether it's read out of it later or copied now.
+    if(dataOffset + data_length > (size_t)length)
+      return BITMAP_ERROR_TOO_SHORT;
+    if(borrowBuffer){
+      colorData = wholeFileBytes + dataOffset;
+      colorDataBorrowed = true;
+      return BITMAP_SUCCESS;
+    }
+
+    colorData = (uint8_t *)takeStorage(data_length);
+    if(colorData == 0)
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    memcpy(colorData, wholeFileBytes + dataOffset, data_length);
+    return BITMAP_SUCCESS;
+}
+
+BITMAP_RESULT_t ESPBitmapBase::storeRLE(const uint8_t *data, size_t length)
+{
+    if(keepCompressed){
+      //compressed data coming from a caller's buffer can be indexed right where it is.
+      if(data != colorData && borrowBuffer){
+        colorData = (uint8_t *)data;
+        colorDataBorrowed = true;
+      }
+      else if(data != colorData){
+        colorData = (uint8_t *)takeStorage(length);
+        if(colorData == 0)
+          return BITMAP_ERROR_OUT_OF_MEMORY;
+        memcpy(colorData, data, length);
+      }
+      data_length = length;
+      return indexRLE(colorData, length);
+    }
+
+    uint8_t *expanded = (uint8_t *)takeStorage(scanlineWidth * height);
+    if(expanded == 0)
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    expandRLE(data, length, expanded);
+    colorData = expanded;
+    colorDataBorrowed = false;
+    data_length = scanlineWidth * height;
+    return BITMAP_SUCCESS;
+}
+
+void ESPBitmapBase::expandRLE(const uint8_t *data, size_t length, uint8_t *dst)
+{
+    memset(dst, 0, scanlineWidth * height);
+
+    ESPBitmapRLE rle;
+    rle.begin(bitsPerPixel, width);
+    size_t used = 0;
+    int32_t row = 0;
+    while(row < height){
+      used += rle.decode(data + used, length - used, dst + scanlineWidth * row);
+      //ran out of data or hit the end of the bitmap, the rest stays empty.
+      if(!rle.rowDone || rle.endOfBitmap)
+        break;
+      row += 1 + rle.skippedRows;
+    }
+}
+
+BITMAP_RESULT_t ESPBitmapBase::indexRLE(const uint8_t *data, size_t length)
+{
+    rleRows = (BITMAP_RLE_ROW_t *)takeStorage(height * sizeof(BITMAP_RLE_ROW_t));
+    rleScanline = (uint8_t *)takeStorage(scanlineWidth);
+    if(rleRows == 0 || rleScanline == 0){
+      releaseRLE();
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    }
+
+    //decode it all once (into the row cache as scratch) to find out where every row starts.
+    ESPBitmapRLE rle;
+    rle.begin(bitsPerPixel, width);
+    size_t used = 0;
+    int32_t row = 0;
+    while(row < height && !rle.endOfBitmap && used < length){
+      rleRows[row].offset = used;
+      rleRows[row].startX = rle.x;
+      memset(rleScanline, 0, scanlineWidth);
+      used += rle.decode(data + used, length - used, rleScanline);
+      row++;
+      if(!rle.rowDone)
+        break;
+      for(int32_t skipped = 0; skipped < rle.skippedRows && row < height; skipped++)
+        rleRows[row++].offset = BITMAP_RLE_EMPTY_ROW;
+    }
+    for(; row < height; row++)
+      rleRows[row].offset = BITMAP_RLE_EMPTY_ROW;
+
+    rleCachedRow = -1;
+    return BITMAP_SUCCESS;
+}
+
+const uint8_t *ESPBitmapBase::rleRow(const uint8_t *data, int row)
+{
+    if(row != rleCachedRow){
+      memset(rleScanline, 0, scanlineWidth);
+      if(rleRows[row].offset != BITMAP_RLE_EMPTY_ROW){
+        ESPBitmapRLE rle;
+        rle.begin(bitsPerPixel, width);
+        rle.x = rleRows[row].startX;
+        rle.decode(data + rleRows[row].offset, data_length - rleRows[row].offset, rleScanline);
+      }
+      rleCachedRow = row;
+    }
+    return rleScanline;
+}
+
+const uint8_t *ESPBitmapBase::fetchRow(int row)
+{
+    return rleRows ? rleRow(colorData, row) : 0;
+}
+
+void ESPBitmapBase::releaseRLE()
+{
+    //the row table and row cache are in storage.
+    rleRows = 0;
+    rleScanline = 0;
+    rleCachedRow = -1;
+}
+
+void ESPBitmapBase::setDecodeSize(int32_t w, int32_t h, BITMAP_SCALE_t filter)
+{
+    targetWidth = w;
+    targetHeight = h;
+    scaleFilter = filter;
+}
+
+void ESPBitmapBase::setDecodeRect(int32_t x, int32_t y, int32_t w, int32_t h)
+{
+    cropX = x;
+    cropY = y;
+    cropWidth = w;
+    cropHeight = h;
+}
+
+BITMAP_RESULT_t ESPBitmapBase::beginScale()
+{
+    releaseScale();
+    if(targetWidth <= 0 && targetHeight <= 0 && (cropWidth <= 0 || cropHeight <= 0))
+      return BITMAP_SUCCESS;
+
+    //the window, clipped to the image.
+    int32_t x0 = 0;
+    int32_t y0 = 0;
+    int32_t x1 = width;
+    int32_t y1 = height;
+    if(cropWidth > 0 && cropHeight > 0){
+      x0 = cropX > 0 ? cropX : 0;
+      y0 = cropY > 0 ? cropY : 0;
+      if((int64_t)cropX + cropWidth < x1)
+        x1 = cropX + cropWidth;
+      if((int64_t)cropY + cropHeight < y1)
+        y1 = cropY + cropHeight;
+      if(x0 >= x1 || y0 >= y1)
+        return BITMAP_ERROR_EMPTY_CROP;
+    }
+    int32_t sourceWidth = x1 - x0;
+    int32_t sourceHeight = y1 - y0;
+
+    //a missing side keeps the aspect ratio, and neither side grows.
+    int32_t w = sourceWidth;
+    int32_t h = sourceHeight;
+    if(targetWidth > 0 || targetHeight > 0){
+      w = targetWidth;
+      h = targetHeight;
+      if(w <= 0)
+        w = (int32_t)((int64_t)sourceWidth * h / sourceHeight);
+      if(h <= 0)
+        h = (int32_t)((int64_t)sourceHeight * w / sourceWidth);
+      if(w < 1)
+        w = 1;
+      if(h < 1)
+        h = 1;
+      if(w > sourceWidth)
+        w = sourceWidth;
+      if(h > sourceHeight)
+        h = sourceHeight;
+    }
+    //columns are mapped with 16 bits, nothing that wide fits in memory anyway.
+    if((w == width && h == height) || width > 0xFFFF)
+      return BITMAP_SUCCESS;
+
+    scale = new ScaleState();
+    if(scale == 0)
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    ScaleState &state = *scale;
+    state.x = x0;
+    state.firstRow = flipped ? y0 : height - y1;
+    state.sourceWidth = sourceWidth;
+    state.sourceHeight = sourceHeight;
+    state.width = w;
+    state.height = h;
+    state.bitsPerPixel = scaleFilter == BITMAP_SCALE_BOX ? 24 : bitsPerPixel;
+    state.scanlineWidth = 4 * ((w * state.bitsPerPixel + 31) / 32);
+
+    bool box = scaleFilter == BITMAP_SCALE_BOX;
+    state.columns = new uint16_t[box ? sourceWidth : w];
+    state.row = new uint8_t[state.scanlineWidth]();
+    state.sourceRow = new uint8_t[scanlineWidth];
+    if(box){
+      state.columnCounts = new uint16_t[w]();
+      state.sums = new uint32_t[w * 3]();
+      state.colors = new PIXEL_t[sourceWidth];
+    }
+    if(state.columns == 0 || state.row == 0 || state.sourceRow == 0
+       || (box && (state.columnCounts == 0 || state.sums == 0 || state.colors == 0))){
+      releaseScale();
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    }
+    BITMAP_STAT(statAllocated(sizeof(ScaleState) + (box ? sourceWidth : w) * sizeof(uint16_t) + state.scanlineWidth + scanlineWidth));
+    BITMAP_STAT(if(box) statAllocated(w * (sizeof(uint16_t) + 3 * sizeof(uint32_t)) + sourceWidth * sizeof(PIXEL_t)));
+
+    //nearest picks the source column under the center of each reduced one,
+    //box adds every column of the window to the reduced one it falls in.
+    if(box){
+      for(int32_t x = 0; x < sourceWidth; x++){
+        state.columns[x] = (uint16_t)((int64_t)x * w / sourceWidth);
+        state.columnCounts[state.columns[x]]++;
+      }
+    }
+    else{
+      for(int32_t x = 0; x < w; x++)
+        state.columns[x] = (uint16_t)(x0 + (int64_t)(2 * x + 1) * sourceWidth / (2 * w));
+    }
+    return BITMAP_SUCCESS;
+}
+
+void ESPBitmapBase::scaleRow(ScaleState &state, const uint8_t *scanline)
+{
+    //rows outside the window are only counted.
+    int32_t sourceRow = state.sourceRows++ - state.firstRow;
+    if(sourceRow < 0 || sourceRow >= state.sourceHeight)
+      return;
+    const uint16_t *columns = state.columns;
+    uint8_t *dst = state.row;
+
+    if(scaleFilter == BITMAP_SCALE_BOX){
+      PIXEL_t *colors = state.colors;
+      sourceRowColors(scanline, state.x, state.sourceWidth, colors);
+      for(int32_t x = 0; x < state.sourceWidth; x++){
+        uint32_t *sum = state.sums + 3 * columns[x];
+        sum[0] += colors[x].b;
+        sum[1] += colors[x].g;
+        sum[2] += colors[x].r;
+      }
+      state.rowsSummed++;
+
+      //that was the last source row of this reduced row, store the averages as BGR.
+      if(sourceRow + 1 == state.sourceHeight || (int64_t)(sourceRow + 1) * state.height / state.sourceHeight != state.nextRow){
+        for(int32_t x = 0; x < state.width; x++){
+          uint32_t n = (uint32_t)state.columnCounts[x] * state.rowsSummed;
+          for(int c = 0; c < 3; c++)
+            dst[3 * x + c] = (uint8_t)((state.sums[3 * x + c] + n / 2) / n);
+        }
+        memset(state.sums, 0, state.width * 3 * sizeof(uint32_t));
+        state.rowsSummed = 0;
+        storeScaledRow(dst, state.nextRow++);
+      }
+      return;
+    }
+
+    //nearest, every reduced row whose center falls on this source row.
+    while(state.nextRow < state.height && (int64_t)(2 * state.nextRow + 1) * state.sourceHeight / (2 * state.height) == sourceRow){
+      //a window that isn't reduced across is one run of whole bytes.
+      if(state.width == state.sourceWidth && bitsPerPixel >= 8){
+        memcpy(dst, scanline + state.x * (bitsPerPixel / 8), state.width * (bitsPerPixel / 8));
+        storeScaledRow(dst, state.nextRow++);
+        continue;
+      }
+      switch(bitsPerPixel){
+        case 1:
+        case 4:{
+          memset(dst, 0, state.scanlineWidth);
+          uint8_t mask = (1 << bitsPerPixel) - 1;
+          for(int32_t x = 0; x < state.width; x++){
+            uint32_t bit = (uint32_t)columns[x] * bitsPerPixel;
+            uint8_t index = (scanline[bit >> 3] >> (8 - bitsPerPixel - (bit & 7))) & mask;
+            bit = x * bitsPerPixel;
+            dst[bit >> 3] |= index << (8 - bitsPerPixel - (bit & 7));
+          }
+          break;
+        }
+        case 8:
+          for(int32_t x = 0; x < state.width; x++)
+            dst[x] = scanline[columns[x]];
+          break;
+        default:{
+          int bytes = bitsPerPixel / 8;
+          for(int32_t x = 0; x < state.width; x++)
+            memcpy(dst + x * bytes, scanline + columns[x] * bytes, bytes);
+          break;
+        }
+      }
+      storeScaledRow(dst, state.nextRow++);
+    }
+}
+
+void ESPBitmapBase::scaleRLE(const uint8_t *data, size_t length)
+{
+    //every row up to the end of the window has to be decoded, the rest aren't needed.
+    uint8_t *scanline = scale->sourceRow;
+    int32_t endRow = scale->firstRow + scale->sourceHeight;
+    ESPBitmapRLE rle;
+    rle.begin(bitsPerPixel, width);
+    size_t used = 0;
+    while(scale->sourceRows < endRow){
+      memset(scanline, 0, scanlineWidth);
+      used += rle.decode(data + used, length - used, scanline);
+      scaleRow(scanline);
+      //ran out of data or hit the end of the bitmap, endScale fills in the rest.
+      if(!rle.rowDone || rle.endOfBitmap)
+        break;
+      memset(scanline, 0, scanlineWidth);
+      for(int32_t skipped = 0; skipped < rle.skippedRows && scale->sourceRows < endRow; skipped++)
+        scaleRow(scanline);
+    }
+}
+
+BITMAP_RESULT_t ESPBitmapBase::scaleFileData(const uint8_t *wholeFileBytes, int32_t length)
+{
+    //RLE data is never trusted to stay inside the buffer, uncompressed data needs every row.
+    if(dataOffset > length
+       || (!isRLE() && dataOffset + scanlineWidth * height > (size_t)length)){
+      releaseScale();
+      return BITMAP_ERROR_TOO_SHORT;
+    }
+
+    if(isRLE()){
+      if(data_length > (size_t)(length - dataOffset))
+        data_length = length - dataOffset;
+      scaleRLE(wholeFileBytes + dataOffset, data_length);
+    }
+    else{
+      int32_t endRow = scale->firstRow + scale->sourceHeight;
+      scale->sourceRows = scale->firstRow;
+
+      //each worker builds its rows in buffers of its own, they only share the column tables.
+      //if there's no memory for those it's done on this thread alone.
+      int count = rowWorkers(scale->height);
+      ScaleState *states = count > 1 ? new ScaleState[count] : 0;
+      bool box = scaleFilter == BITMAP_SCALE_BOX;
+      size_t workerBytes = scale->scanlineWidth + (box ? scale->width * 3 * sizeof(uint32_t) + scale->sourceWidth * sizeof(PIXEL_t) : 0);
+      bool parallel = states != 0;
+      for(int i = 0; parallel && i < count; i++){
+        ScaleState &state = states[i];
+        state = *scale;
+        if(i == 0)
+          continue;
+        state.row = new uint8_t[state.scanlineWidth]();
+        state.sums = box ? new uint32_t[state.width * 3]() : 0;
+        state.colors = box ? new PIXEL_t[state.sourceWidth] : 0;
+        parallel = state.row != 0 && (!box || (state.sums != 0 && state.colors != 0));
+      }
+
+      if(parallel){
+        BITMAP_STAT(statAllocated(workerBytes * (count - 1)));
+        ScaleJob job = { wholeFileBytes + dataOffset, states };
+        runRows(scale->height, count, scaleRows, &job);
+        scale->sourceRows = endRow;
+        scale->nextRow = scale->height;
+        BITMAP_STAT(statFreed(workerBytes * (count - 1)));
+      }
+      else{
+        for(int32_t row = scale->firstRow; row < endRow; row++)
+          scaleRow(wholeFileBytes + dataOffset + scanlineWidth * row);
+      }
+
+      if(states != 0){
+        for(int i = 1; i < count; i++){
+          if(states[i].row != 0)
+            delete[] states[i].row;
+          if(states[i].sums != 0)
+            delete[] states[i].sums;
+          if(states[i].colors != 0)
+            delete[] states[i].colors;
+        }
+        delete[] states;
+      }
+    }
+    return endScale();
+}
+
+int32_t ESPBitmapBase::firstSourceRow(const ScaleState &state, int32_t index)
+{
+    if(index >= state.height)
+      return state.sourceHeight;
+    //box rows are made of the source rows that map onto them, nearest ones of the row under their center.
+    if(scaleFilter == BITMAP_SCALE_BOX)
+      return (int32_t)(((int64_t)index * state.sourceHeight + state.height - 1) / state.height);
+    return (int32_t)((int64_t)(2 * index + 1) * state.sourceHeight / (2 * state.height));
+}
+
+void ESPBitmapBase::scaleRows(ESPBitmapBase *bitmap, void *arg, int32_t first, int32_t end, int worker)
+{
+    ScaleJob &job = *(ScaleJob *)arg;
+    ScaleState &state = job.states[worker];
+
+    //start where the first of these reduced rows starts, as if the rows before it had been seen.
+    int32_t row = bitmap->firstSourceRow(state, first);
+    int32_t endRow = bitmap->firstSourceRow(state, end);
+    state.nextRow = first;
+    state.sourceRows = state.firstRow + row;
+    state.rowsSummed = 0;
+    for(; row < endRow; row++)
+      bitmap->scaleRow(state, job.pixels + bitmap->scanlineWidth * (state.firstRow + row));
+}
+
+BITMAP_RESULT_t ESPBitmapBase::endScale()
+{
+    //rows of the window that never arrived (RLE data that ended early) are empty.
+    memset(scale->sourceRow, 0, scanlineWidth);
+    while(scale->sourceRows < scale->firstRow + scale->sourceHeight)
+      scaleRow(scale->sourceRow);
+
+    ScaleState reduced = *scale;
+    releaseScale();
+    width = reduced.width;
+    height = reduced.height;
+    scanlineWidth = reduced.scanlineWidth;
+    bitsPerPixel = reduced.bitsPerPixel;
+    compression = BI_UNCOMPRESSED;
+    data_length = scanlineWidth * height;
+    return BITMAP_SUCCESS;
+}
+
+void ESPBitmapBase::releaseScale()
+{
+    if(scale == 0)
+      return;
+    bool box = scale->columnCounts != 0;
+    BITMAP_STAT(statFreed(sizeof(ScaleState) + (box ? scale->sourceWidth : scale->width) * sizeof(uint16_t) + scale->scanlineWidth + scanlineWidth));
+    BITMAP_STAT(if(box) statFreed(scale->width * (sizeof(uint16_t) + 3 * sizeof(uint32_t)) + scale->sourceWidth * sizeof(PIXEL_t)));
+    if(scale->columns != 0)
+      delete[] scale->columns;
+    if(scale->columnCounts != 0)
+      delete[] scale->columnCounts;
+    if(scale->sums != 0)
+      delete[] scale->sums;
+    if(scale->colors != 0)
+      delete[] scale->colors;
+    if(scale->row != 0)
+      delete[] scale->row;
+    if(scale->sourceRow != 0)
+      delete[] scale->sourceRow;
+    delete scale;
+    scale = 0;
+}
+
+BITMAP_RESULT_t ESPBitmapBase::allocateScaled()
+{
+    colorData = (uint8_t *)takeStorage(scale->scanlineWidth * scale->height);
+    if(colorData == 0)
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    return BITMAP_SUCCESS;
+}
+
+void ESPBitmapBase::storeScaledRow(const uint8_t *row, int32_t index)
+{
+    memcpy(colorData + scale->scanlineWidth * index, row, scale->scanlineWidth);
+}
+
+void ESPBitmapBase::reset(bool keepMemory)
+{
+    releaseLoad();
+    releaseScale();
+    clearImage();
+    if(!keepMemory)
+      releaseStorage();
+}
+
+void ESPBitmapBase::clearImage()
+{
+    releaseRLE();
+    colorData = 0;
+    colorDataBorrowed = false;
+    storageUsed = 0;
+    width = 0;
+    height = 0;
+    dataOffset = 0;
+    data_length = 0;
+    bitsPerPixel = 0;
+    scanlineWidth = 0;
+    flipped = false;
+    compression = BI_UNCOMPRESSED;
+    rgb565 = false;
+#ifdef ESP8266
+    fetchedUrl = String();
+    fetchedETag = String();
+    fetchedLastModified = String();
+#endif
+}
+
+void ESPBitmapBase::setAllocator(BITMAP_ALLOC_t alloc, BITMAP_FREE_t freeBlock, void *context)
+{
+    //the block has to go back to whoever it came from.
+    reset(false);
+    storageAlloc = alloc;
+    storageFree = freeBlock;
+    storageContext = context;
+}
+
+#ifdef ESPBITMAP_THREADS
+//setWorkers' run when none is given, a std::thread for each worker but the first, which is this thread.
+static void runThreads(BITMAP_JOB_t job, void *arg, int workers, void * /*context*/)
+{
+    std::thread *threads = new std::thread[workers - 1];
+    for(int i = 1; i < workers; i++)
+      threads[i - 1] = std::thread(job, arg, i);
+    job(arg, 0);
+    for(int i = 1; i < workers; i++)
+      threads[i - 1].join();
+    delete[] threads;
+}
+#endif
+
+void ESPBitmapBase::setWorkers(int count, BITMAP_RUN_t run, void *context)
+{
+    workers = count > 1 ? count : 1;
+    workerRun = run;
+    workerContext = context;
+}
+
+BITMAP_RUN_t ESPBitmapBase::runner()
+{
+#ifdef ESPBITMAP_THREADS
+    if(workerRun == 0)
+      return runThreads;
+#endif
+    return workerRun;
+}
+
+int ESPBitmapBase::rowWorkers(int32_t rows)
+{
+    if(runner() == 0)
+      return 1;
+    int count = rows / BITMAP_WORKER_ROWS;
+    if(count > workers)
+      count = workers;
+    return count > 1 ? count : 1;
+}
+
+void ESPBitmapBase::runRows(int32_t rows, int count, BITMAP_ROWS_t work, void *arg)
+{
+    if(count <= 1){
+      work(this, arg, 0, rows, 0);
+      return;
+    }
+    struct Split {
+      ESPBitmapBase *bitmap;
+      BITMAP_ROWS_t work;
+      void *arg;
+      int32_t rows;
+      int count;
+      static void run(void *split, int worker) {
+        Split &s = *(Split *)split;
+        s.work(s.bitmap, s.arg, (int32_t)((int64_t)s.rows * worker / s.count), (int32_t)((int64_t)s.rows * (worker + 1) / s.count), worker);
+      }
+    } split = { this, work, arg, rows, count };
+    runner()(Split::run, &split, count, workerContext);
+}
+
+BITMAP_RESULT_t ESPBitmapBase::reserveStorage(size_t bytes)
+{
+    storageUsed = 0;
+    if(bytes <= storageSize)
+      return BITMAP_SUCCESS;
+
+    releaseStorage();
+    storage = allocateStorage(bytes);
+    if(storage == 0)
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    storageSize = bytes;
+    return BITMAP_SUCCESS;
+}
+
+uint8_t *ESPBitmapBase::allocateStorage(size_t bytes)
+{
+    uint8_t *block = storageAlloc != 0 ? (uint8_t *)storageAlloc(bytes, storageContext) : new uint8_t[bytes];
+    BITMAP_STAT(if(block != 0) statAllocated(bytes));
+    return block;
+}
+
+void ESPBitmapBase::replaceStorage(uint8_t *block, size_t bytes)
+{
+    releaseStorage();
+    storage = block;
+    storageSize = bytes;
+    storageUsed = 0;
+}
+
+void *ESPBitmapBase::takeStorage(size_t bytes)
+{
+    bytes = storageBytes(bytes);
+    if(storage == 0 || bytes > storageSize - storageUsed)
+      return 0;
+    void *piece = storage + storageUsed;
+    storageUsed += bytes;
+    return piece;
+}
+
+void ESPBitmapBase::releaseStorage()
+{
+    if(storage != 0){
+      if(storageFree != 0)
+        storageFree(storage, storageContext);
+      else if(storageAlloc == 0)
+        delete[] storage;
+      BITMAP_STAT(statFreed(storageSize));
+    }
+    storage = 0;
+    storageSize = 0;
+    storageUsed = 0;
+}
+
+BITMAP_RESULT_t ESPBitmapBase::beginImage(size_t colors, size_t pixelLength, bool borrowed)
+{
+    BITMAP_RESULT_t result = beginScale();
+    if(result != BITMAP_SUCCESS)
+      return result;
+    result = reserveStorage(storageNeeded(colors, pixelLength, borrowed));
+    if(result == BITMAP_SUCCESS && scale != 0)
+      result = allocateScaled();
+    return result;
+}
+
+size_t ESPBitmapBase::colorDataStorage(size_t pixelLength, bool borrowed)
+{
+    if(scale != 0)
+      return storageBytes(scale->scanlineWidth * scale->height);
+    if(isRLE() && keepCompressed)
+      return (borrowed ? 0 : storageBytes(pixelLength)) + storageBytes(height * sizeof(BITMAP_RLE_ROW_t)) + storageBytes(scanlineWidth);
+    if(isRLE())
+      return storageBytes(scanlineWidth * height);
+    return borrowed ? 0 : storageBytes(scanlineWidth * height);
+}
+
+void ESPBitmapBase::setKeepCompressed(bool keep)
+{
+    keepCompressed = keep;
+}
+
+void ESPBitmapBase::setBorrowBuffer(bool borrow)
+{
+    borrowBuffer = borrow;
+}
+
+ESPBitmapBase::~ESPBitmapBase()
+{
+    releaseLoad();
+    releaseScale();
+    releaseStorage();
+}
+
+//RLE decoder states, what the next byte is.
+enum {
+  RLE_COUNT = 0,    //repeat count, or 0 for an escape
+  RLE_VALUE,        //value to repeat
+  RLE_ESCAPE,       //0 end of line, 1 end of bitmap, 2 delta, otherwise an absolute run length
+  RLE_DELTA_X,
+  RLE_DELTA_Y,
+  RLE_ABSOLUTE,     //literal pixels
+  RLE_PAD           //absolute runs are padded to a 16 bit boundary
+};
+
+void ESPBitmapRLE::begin(int16_t bits, int32_t rowWidth)
+{
+    bitsPerPixel = bits;
+    width = rowWidth;
+    state = RLE_COUNT;
+    rowDone = false;
+    skippedRows = 0;
+    endOfBitmap = false;
+    x = 0;
+}
+
+inline void ESPBitmapRLE::put(uint8_t *scanline, uint8_t index)
+{
+    if(x < width){
+      if(bitsPerPixel == 8)
+        scanline[x] = index;
+      else
+        scanline[x >> 1] |= (x & 1) ? index : index << 4;
+    }
+    x++;
+}
+
+size_t ESPBitmapRLE::decode(const uint8_t *src, size_t count, uint8_t *scanline)
+{
+    rowDone = endOfBitmap;
+    skippedRows = endOfBitmap ? 0x7FFFFFFF : 0;
+
+    size_t used = 0;
+    while(used < count && !rowDone){
+      uint8_t b = src[used++];
+      switch(state){
+        case RLE_COUNT:
+          runLength = b;
+          state = b ? RLE_VALUE : RLE_ESCAPE;
+          break;
+        case RLE_VALUE:
+          if(bitsPerPixel == 8){
+            if(x < width)
+              memset(scanline + x, b, (width - x) < runLength ? (width - x) : runLength);
+            x += runLength;
+          }
+          else {
+            //RLE4 runs alternate between the high and low nibble.
+            for(uint8_t i = 0; i < runLength; i++)
+              put(scanline, (i & 1) ? (b & 0x0F) : (b >> 4));
+          }
+          state = RLE_COUNT;
+          break;
+        case RLE_ESCAPE:
+          state = RLE_COUNT;
+          if(b == 0){
+            rowDone = true;
+            x = 0;
+          }
+          else if(b == 1){
+            rowDone = true;
+            endOfBitmap = true;
+            skippedRows = 0x7FFFFFFF;
+          }
+          else if(b == 2){
+            state = RLE_DELTA_X;
+          }
+          else {
+            runLength = b;
+            //the literal bytes are padded to an even count
+            padAbsolute = ((bitsPerPixel == 8 ? b : (b + 1) / 2) & 1) != 0;
+            state = RLE_ABSOLUTE;
+          }
+          break;
+        case RLE_DELTA_X:
+          deltaX = b;
+          state = RLE_DELTA_Y;
+          break;
+        case RLE_DELTA_Y:
+          state = RLE_COUNT;
+          x += deltaX;
+          if(b > 0){
+            rowDone = true;
+            skippedRows = b - 1;
+          }
+          break;
+        case RLE_ABSOLUTE:
+          if(bitsPerPixel == 8){
+            put(scanline, b);
+            runLength--;
+          }
+          else {
+            put(scanline, b >> 4);
+            if(--runLength > 0){
+              put(scanline, b & 0x0F);
+              runLength--;
+            }
+          }
+          if(runLength == 0)
+            state = padAbsolute ? RLE_PAD : RLE_COUNT;
+          break;
+        case RLE_PAD:
+          state = RLE_COUNT;
+          break;
+      }
+    }
+    return used;
+}
+
+#ifdef ESP8266
+bool ESPBitmapBase::readStreamBytes(Stream* stream, uint8_t *dst, size_t count, unsigned long startMs, int timeoutMs){
+  while(count > 0){
+    size_t size = stream->available();
+    if(size){
+      size_t c = stream->readBytes(dst, size > count ? count : size);
+      BITMAP_STAT(stats.readCalls++);
+      BITMAP_STAT(stats.bytesRead += c);
+      dst += c;
+      count -= c;
+    }
+    else if(millis() - startMs < (unsigned long)timeoutMs){
+      BITMAP_STAT(stats.stalls++);
+      BITMAP_STAT(uint32_t stallStart = micros());
+      delay(1);
+      BITMAP_STAT(stats.stallMicros += micros() - stallStart);
+    }
+    else{
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ESPBitmapBase::skipStreamBytes(Stream* stream, size_t count, unsigned long startMs, int timeoutMs){
+  uint8_t theVoid[16];
+  while(count > 0){
+    size_t chunk = count > sizeof(theVoid) ? sizeof(theVoid) : count;
+    if(!readStreamBytes(stream, theVoid, chunk, startMs, timeoutMs))
+      return false;
+    count -= chunk;
+  }
+  return true;
+}
+
+bool ESPBitmapBase::readStreamRLERow(Stream* stream, StreamRLEState &state, uint8_t *scanline, unsigned long startMs, int timeoutMs){
+  memset(scanline, 0, scanlineWidth);
+
+  //rows a delta jumped over are just empty.
+  if(state.emptyRows > 0){
+    state.emptyRows--;
+    return true;
+  }
+
+  do {
+    if(state.used == state.length){
+      //once the data runs out any remaining rows are empty.
+      if(state.remaining == 0)
+        return true;
+      state.length = state.remaining > sizeof(state.chunk) ? sizeof(state.chunk) : state.remaining;
+      state.used = 0;
+      if(!readStreamBytes(stream, state.chunk, state.length, startMs, timeoutMs))
+        return false;
+      state.remaining -= state.length;
+    }
+    state.used += state.rle.decode(state.chunk + state.used, state.length - state.used, scanline);
+  } while(!state.rle.rowDone);
+
+  state.emptyRows = state.rle.skippedRows;
+  return true;
+}
+#endif //ESP8266
+
+#ifdef ESPBITMAP_STATS
+void ESPBitmapBase::resetStats()
+{
+    memset(&stats, 0, sizeof(stats));
+    stats.phaseStart = micros();
+}
+
+void ESPBitmapBase::statPhase(uint32_t &phase)
+{
+    uint32_t now = micros();
+    phase += now - stats.phaseStart;
+    stats.phaseStart = now;
+}
+
+void ESPBitmapBase::statAllocated(size_t bytes)
+{
+    stats.allocations++;
+    stats.allocatedBytes += bytes;
+    stats.currentBytes += bytes;
+    if(stats.currentBytes > stats.peakBytes)
+      stats.peakBytes = stats.currentBytes;
+}
+
+void ESPBitmapBase::statFreed(size_t bytes)
+{
+    stats.currentBytes -= bytes;
+}
+
+void ESPBitmapBase::printStats()
+{
+    Serial.print(F("ESPBitmap Stats: read "));
+    Serial.print(stats.bytesRead);
+    Serial.print(F(" bytes in "));
+    Serial.print(stats.readCalls);
+    Serial.print(F(" calls, "));
+    Serial.print(stats.stalls);
+    Serial.print(F(" stalls ("));
+    Serial.print(stats.stallMicros);
+    Serial.print(F("us) | header "));
+    Serial.print(stats.headerMicros);
+    Serial.print(F("us, palette "));
+    Serial.print(stats.paletteMicros);
+    Serial.print(F("us, data "));
+    Serial.print(stats.dataMicros);
+    Serial.print(F("us | "));
+    Serial.print(stats.allocations);
+    Serial.print(F(" allocations, "));
+    Serial.print(stats.allocatedBytes);
+    Serial.print(F(" bytes, peak "));
+    Serial.println(stats.peakBytes);
+}
+#endif
+
 int32_t ESPBitmapBase::getWidth() {
   return width;
 }
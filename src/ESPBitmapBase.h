@@ -55,8 +55,63 @@ struct BITMAP_INFO_HEADER_t {
   int32_t importantColors; //number of colors that are considered important in the palette (must be start of palette) if zero used, all colors are important. Typically 0
 };
 
+//where a stored row starts in RLE compressed data, so rows can be decoded on their own.
+struct BITMAP_RLE_ROW_t {
+  uint32_t offset;  //byte offset of the first code of the row, BITMAP_RLE_EMPTY_ROW if the row was skipped over
+  uint16_t startX;  //pixel the row starts at (non zero only when a delta jumped into the row)
+};
+
+#define BITMAP_RLE_EMPTY_ROW 0xFFFFFFFF
+
+//BI_BITFIELDS channel masks come right after the first 40 bytes of the info header
+//(inside it for the bigger V2-V5 headers, in front of the pixel data for a 40 byte one).
+#define BITMAP_MASKS_OFFSET 54
+
+//getFromStream reads the stream this many bytes at a time into a buffer on the stack, and parses them from there.
+#define BITMAP_STREAM_BUFFER_SIZE 256
+//most bytes one call to poll() takes in, so a stream that always has data (like a file) doesn't hog loop().
+#define BITMAP_POLL_BYTES 4096
+//fewest rows each worker of a parallel decode gets, smaller images are split across fewer workers.
+#define BITMAP_WORKER_ROWS 8
+//default size of each chunk of the ring a pipelined getFromStream reads into, a TCP packet.
+#define BITMAP_PIPELINE_CHUNK 1460
+
+//one color channel of a 16 or 32bpp pixel, worked out from its mask once when the header is read.
+//((pixel & mask) >> rightShift) << leftShift puts the channel's top bit at bit 7, the replicate
+//shifts then copy the high bits down so a 5 or 6 bit channel still reaches 255.
+struct BITMAP_CHANNEL_t {
+  uint32_t mask;
+  uint8_t rightShift;
+  uint8_t leftShift;
+  uint8_t replicate1;
+  uint8_t replicate2;
+};
+
 #pragma pack(pop)
 
+//what the last load did and where its time went. only collected when the library is built with
+//ESPBITMAP_STATS defined, otherwise the stats member and all the counting compile away to nothing.
+struct BITMAP_STATS_t {
+  uint32_t bytesRead;       //bytes taken from streams
+  uint32_t readCalls;       //readBytes calls made on streams
+  uint32_t stalls;          //times a stream had nothing available when we wanted data
+  uint32_t stallMicros;     //time spent waiting for those (blocking calls only, poll() never waits)
+  uint32_t headerMicros;    //from the start of the load until the headers were parsed
+  uint32_t paletteMicros;   //then until the pixel data started (masks, palette, gaps)
+  uint32_t dataMicros;      //then until all the pixel data was stored (read, expanded, converted)
+  uint32_t allocations;     //number of buffers allocated by the load
+  uint32_t allocatedBytes;  //their total size
+  uint32_t currentBytes;    //bytes of them not freed yet
+  uint32_t peakBytes;       //most bytes allocated at once
+  uint32_t phaseStart;      //micros() the current phase started at
+};
+
+#ifdef ESPBITMAP_STATS
+ #define BITMAP_STAT(x) x
+#else
+ #define BITMAP_STAT(x)
+#endif
+
 typedef enum
 {
   BI_UNCOMPRESSED = 0, //RGB format
@@ -74,18 +129,88 @@ typedef enum
   BITMAP_ERROR_INVALID_IHEADER,
   BITMAP_ERROR_UNSUPPORTED_BITDEPTH,
   BITMAP_ERROR_OUT_OF_MEMORY,
-  BITMAP_ERROR_FETCH_FAILED
+  BITMAP_ERROR_FETCH_FAILED,
+  BITMAP_IN_PROGRESS, //a stream started with beginStream isn't done yet, keep calling poll()
+  BITMAP_ERROR_EMPTY_CROP //the rectangle given to setDecodeRect is entirely outside the image
 } BITMAP_RESULT_t;
 
+//how setDecodeSize reduces an image.
+typedef enum
+{
+  BITMAP_SCALE_NEAREST = 0, //each pixel is the source pixel closest to its center, keeps the image's own format
+  BITMAP_SCALE_BOX          //each pixel is the average of all the source pixels it covers, stored as 24bpp
+} BITMAP_SCALE_t;
+
+//allocator for the block of memory images are stored in, see ESPBitmapBase::setAllocator.
+typedef void *(*BITMAP_ALLOC_t)(size_t bytes, void *context);
+typedef void (*BITMAP_FREE_t)(void *block, void *context);
+//runs job(arg, worker) for every worker from 0 to workers - 1 at the same time, and returns once they have
+//all finished. see ESPBitmapBase::setWorkers.
+typedef void (*BITMAP_JOB_t)(void *arg, int worker);
+typedef void (*BITMAP_RUN_t)(BITMAP_JOB_t job, void *arg, int workers, void *context);
+
+//decodes RLE4 and RLE8 pixel data a piece at a time into uncompressed scanlines.
+//it stops at the end of each row so it works the same on a whole buffer or a trickle of stream bytes.
+class ESPBitmapRLE
+{
+  public:
+    void begin(int16_t bits, int32_t rowWidth);
+
+    //decodes up to count bytes of src into scanline (which must start out zeroed)
+    //and returns how many were used. stops early once the row is done.
+    size_t decode(const uint8_t *src, size_t count, uint8_t *scanline);
+
+    //set by decode when scanline holds a finished row.
+    bool rowDone = false;
+    //number of rows after the finished one that a delta or end of bitmap skipped, they are left empty.
+    int32_t skippedRows = 0;
+    //set once the end of bitmap code is seen, every following row is empty.
+    bool endOfBitmap = false;
+    //pixel the next row starts at.
+    int32_t x = 0;
+
+  private:
+    void put(uint8_t *scanline, uint8_t index);
+
+    uint8_t state = 0;
+    uint8_t runLength = 0;
+    uint8_t runValue = 0;
+    uint8_t deltaX = 0;
+    bool padAbsolute = false;
+    int16_t bitsPerPixel = 8;
+    int32_t width = 0;
+};
+
+class ESPBitmapTransport;
+
 class ESPBitmapBase
 {
 
   public:
+    virtual ~ESPBitmapBase();
+
     //prints to Serial the result according to the code passed.
     void printResult(BITMAP_RESULT_t errCode);
 
     //decodes a bitmap from a buffer array. Expects entire file to be present in the byte array
-    virtual BITMAP_RESULT_t DecodeFileBuffer(uint8_t *wholeFileBytes, int32_t length);
+    virtual BITMAP_RESULT_t DecodeFileBuffer(uint8_t *wholeFileBytes, int32_t length) = 0;
+
+    //everything an image keeps (palette, pixels, row tables) lives in one block of memory. loading another
+    //image into the same object reuses that block when the new one fits, so an object can be kept and reloaded
+    //for as long as you like without the heap breaking up. reset() empties the object, and with keepMemory
+    //false gives the block back too.
+    void reset(bool keepMemory = true);
+    //bytes in the block currently held for images.
+    size_t storageCapacity() { return storageSize; }
+    //where the block comes from, for example a static arena or external ram. freeBlock gets back exactly
+    //what alloc returned, and alloc returning 0 fails the load as out of memory. 0, 0 goes back to new and delete.
+    //call it before loading anything, buffers only needed while loading still come from new.
+    void setAllocator(BITMAP_ALLOC_t alloc, BITMAP_FREE_t freeBlock, void *context = 0);
+    //splits the row by row work of DecodeFileBuffer (converting 16, 24 and 32bpp images, and reducing uncompressed
+    //ones to a decode size or rect) across workers threads, started by run. on the ESP32 each can be a task pinned
+    //to a core. built with ESPBITMAP_THREADS (the host build does) run can be left 0 to use std::thread.
+    //the image is exactly the same as with 1 worker, the default. images of only a few rows use fewer workers.
+    void setWorkers(int workers, BITMAP_RUN_t run = 0, void *context = 0);
 
     int32_t getWidth();
     int32_t getHeight();
@@ -95,16 +220,313 @@ class ESPBitmapBase
     int32_t dataOffset = 0;
     size_t data_length = 0;
     int16_t bitsPerPixel = 0;
+    //bytes per row of pixel data, bitmap rows are padded to a 4 byte boundary.
+    size_t scanlineWidth = 0;
     bool flipped = false;
+    //one of BITMAP_COMPRESSION_t, RLE images are expanded on load unless setKeepCompressed(true) was called.
+    int32_t compression = BI_UNCOMPRESSED;
+
+    //keep RLE4/RLE8 images compressed in ram. a small table of where each row starts is built
+    //so rows can be decoded on their own, and the last row used is kept decoded for fast access.
+    void setKeepCompressed(bool keep);
+
+    //let DecodeFileBuffer read pixel data straight out of the buffer it's given instead of copying it.
+    //the buffer then has to stay valid and unchanged for as long as the bitmap is used, and is never freed by it.
+    //applies to uncompressed pixel data ESPBitmap keeps as is (every bit depth, 1, 4 and 8bpp for ESPBitmap16)
+    //and to RLE images kept compressed, anything else is still converted into memory of its own.
+    void setBorrowBuffer(bool borrow);
+
+    //have DecodeFileBuffer and getFromStream/poll store the image reduced to targetWidth x targetHeight,
+    //shrinking it row by row as the pixel data is read so the full size image is never held in memory.
+    //a target of 0 for width or height keeps the aspect ratio, images are never made bigger, 0, 0 turns it off.
+    //width, height and everything else then describe the reduced image. StreamDecode isn't affected.
+    void setDecodeSize(int32_t targetWidth, int32_t targetHeight, BITMAP_SCALE_t filter = BITMAP_SCALE_NEAREST);
+
+    //have DecodeFileBuffer and getFromStream/poll keep only the w x h window at x, y (0, 0 is the top left),
+    //the rows and columns around it are skipped as they're read. the window is clipped to the image, 0 sized turns it off.
+    //width, height and everything else then describe the window, which setDecodeSize can reduce further.
+    void setDecodeRect(int32_t x, int32_t y, int32_t w, int32_t h);
+
+    //channel layout of 16 and 32bpp images, red, green, blue, alpha.
+    BITMAP_CHANNEL_t channels[4];
+    //16bpp image that is already exactly RGB565, it needs no conversion at all.
+    bool rgb565 = false;
+
+    //pulls one channel out of a 16 or 32bpp pixel as 0-255.
+    static inline uint8_t channelValue(uint32_t pixel, const BITMAP_CHANNEL_t &channel) {
+      uint32_t v = ((pixel & channel.mask) >> channel.rightShift) << channel.leftShift;
+      v |= v >> channel.replicate1;
+      v |= v >> channel.replicate2;
+      return (uint8_t)v;
+    }
+
+#ifdef ESPBITMAP_STATS
+    //filled in by DecodeFileBuffer, getFromStream/poll and StreamDecode, reset when each one starts.
+    BITMAP_STATS_t stats;
+    void printStats();
+#endif
 
     //RGB888-24 to RGB565-16 (565 is standard for adafruit's amazing graphics library)
     //this implimentation is taken from there. 
     static uint16_t Color(uint8_t r, uint8_t g, uint8_t b);
     
 #ifdef ESP8266
+  //fetching the url the current image came from again is a conditional request, when the server says
+  //it hasn't changed (304) the image is kept as it is without downloading or decoding anything.
   BITMAP_RESULT_t fetchImageFromUrl(String imageUrl);
   BITMAP_RESULT_t fetchImageFromUrl(String imageUrl, int timeoutMs);
-  virtual BITMAP_RESULT_t getFromStream(Stream* stream, int len, int timeoutMs);
+  //true when the last fetchImageFromUrl got a 304 and kept the image, nothing needs redrawing.
+  bool fetchNotModified = false;
+  //where fetchImageFromUrl sends its requests, 0 for the default ESPBitmapHTTPTransport.
+  //the bitmap doesn't own it, it has to stay alive while the bitmap fetches.
+  void setTransport(ESPBitmapTransport *transport);
+  //loads the whole image from a stream (http, SD card, SPIFFS...), len is the byte count if known or -1.
+  BITMAP_RESULT_t getFromStream(Stream* stream, int len, int timeoutMs);
+  //makes getFromStream read the stream on a second thread (started by the run given to setWorkers), into a ring of
+  //chunks chunks of chunkBytes, while the calling thread parses and converts what has come in. reading no longer
+  //waits for decoding or decoding for reading, and the ring is all the memory it takes. 0 chunks turns it off.
+  void setPipeline(int chunks, size_t chunkBytes = BITMAP_PIPELINE_CHUNK);
+
+  //non-blocking version of getFromStream. beginStream sets up the load, then call poll() from loop():
+  //each call takes in whatever the stream has available and returns BITMAP_IN_PROGRESS until the image
+  //is loaded (BITMAP_SUCCESS) or fails. the stream must stay valid until then, timing out is up to you
+  //(call cancelStream() to give up). with len -1, the load finishes once all the pixel data is in.
+  BITMAP_RESULT_t beginStream(Stream* stream, int len);
+  BITMAP_RESULT_t poll();
+  void cancelStream();
+#endif //ESP8266
+
+  protected:
+    //RLE4/RLE8 pixel data, which needs decoding before it can be read as scanlines.
+    bool isRLE() { return compression == BI_RLE_8 || compression == BI_RLE_4; }
+
+    //maps an image row (0 is the top) to the order it's stored in.
+    int storedRow(int y) { return flipped ? y : (height - 1) - y; }
+
+    //validates the file and info headers and fills in width, height, bitsPerPixel, flipped and dataOffset.
+    //colorsToLoad is set to the number of palette entries that follow the info header (0 for 24bpp).
+    BITMAP_RESULT_t parseHeaders(BITMAP_FILE_HEADER_t &bitmapHeader, BITMAP_INFO_HEADER_t &bitmapInfo, size_t &colorsToLoad);
+    //reads and validates the headers (and bitfield masks) at the start of a whole file buffer,
+    //and sets data_length (RLE data is cut off at the end of the buffer).
+    BITMAP_RESULT_t parseFileBuffer(const uint8_t *wholeFileBytes, int32_t length, BITMAP_FILE_HEADER_t &bitmapHeader, BITMAP_INFO_HEADER_t &bitmapInfo, size_t &colorsToLoad);
+    //bytes of pixel data after dataOffset: an uncompressed image's rows, or as much RLE data as the headers say, cut
+    //off at the end of the file when its length is known (-1 if not) and at the most any RLE image that size takes.
+    BITMAP_RESULT_t findPixelLength(BITMAP_FILE_HEADER_t &bitmapHeader, BITMAP_INFO_HEADER_t &bitmapInfo, int32_t length, size_t &pixelLength);
+    //number of BI_BITFIELDS mask bytes at BITMAP_MASKS_OFFSET, 0 when the image doesn't have any.
+    size_t maskBytes(BITMAP_INFO_HEADER_t &bitmapInfo);
+    //sets up channels from the masks stored in the file (little endian red, green, blue and maybe alpha).
+    void loadChannelMasks(const uint8_t *masks, size_t count);
+    void setChannelMasks(uint32_t red, uint32_t green, uint32_t blue, uint32_t alpha);
+
+#ifdef ESPBITMAP_STATS
+    void resetStats();
+    //adds the time since the last phase ended to phase.
+    void statPhase(uint32_t &phase);
+    void statAllocated(size_t bytes);
+    void statFreed(size_t bytes);
+#endif
+
+    //the block images are kept in, storageUsed bytes of it are handed out to the current image.
+    uint8_t *storage = 0;
+    size_t storageSize = 0;
+    size_t storageUsed = 0;
+    BITMAP_ALLOC_t storageAlloc = 0;
+    BITMAP_FREE_t storageFree = 0;
+    void *storageContext = 0;
+
+    //setWorkers.
+    int workers = 1;
+    BITMAP_RUN_t workerRun = 0;
+    void *workerContext = 0;
+    //work on rows first to end - 1, done by one worker.
+    typedef void (*BITMAP_ROWS_t)(ESPBitmapBase *bitmap, void *arg, int32_t first, int32_t end, int worker);
+    //setWorkers' run, or std::thread with ESPBITMAP_THREADS, 0 when there's nothing to run workers with.
+    BITMAP_RUN_t runner();
+    //how many workers rows are split across, 1 when they aren't.
+    int rowWorkers(int32_t rows);
+    //splits rows into count even runs and calls work for each of them at the same time.
+    void runRows(int32_t rows, int count, BITMAP_ROWS_t work, void *arg);
+
+    //rounds a piece of storage up to the 4 byte alignment takeStorage hands it out with.
+    static size_t storageBytes(size_t bytes) { return (bytes + 3) & ~(size_t)3; }
+    //makes sure storage holds at least bytes for a new image, reusing the block when it's already big enough.
+    BITMAP_RESULT_t reserveStorage(size_t bytes);
+    //hands out the next bytes of storage for the current image, 0 if reserveStorage didn't ask for enough.
+    void *takeStorage(size_t bytes);
+    void releaseStorage();
+    //a block from setAllocator's alloc (or new), 0 if there isn't the memory. it isn't storage until replaceStorage.
+    uint8_t *allocateStorage(size_t bytes);
+    //releases storage and uses block, of bytes, in its place with nothing handed out yet.
+    void replaceStorage(uint8_t *block, size_t bytes);
+
+    //drops the current image, every pointer into storage and the header fields. classes clear their own parts too.
+    virtual void clearImage();
+    //sets up scaling, then reserves storage for the whole image once the headers are parsed.
+    //pixelLength is the pixel data in the file, borrowed when it's read in place out of the caller's buffer.
+    BITMAP_RESULT_t beginImage(size_t colors, size_t pixelLength, bool borrowed);
+    //storage a class needs for an image with colors palette entries.
+    virtual size_t storageNeeded(size_t colors, size_t pixelLength, bool borrowed) = 0;
+    //storage for the pixels when they're kept in colorData (raw, RLE or reduced), the part of storageNeeded that's the same for everyone.
+    size_t colorDataStorage(size_t pixelLength, bool borrowed);
+
+    //raw pixel data as it was stored in the file (or RLE expanded), format depends on bitsPerPixel.
+    uint8_t *colorData = 0;
+    //colorData points into the caller's buffer (see setBorrowBuffer), it isn't ours to free.
+    bool colorDataBorrowed = false;
+    bool borrowBuffer = false;
+
+    //stores the pixel data of a whole file buffer as colorData, borrowing it, copying it or handing it to storeRLE.
+    BITMAP_RESULT_t storeFileData(uint8_t *wholeFileBytes, int32_t length);
+
+    //stores RLE pixel data as colorData, expanded or compressed and indexed depending on keepCompressed.
+    //data can already be colorData, in which case it's expanded in place of it or kept as is.
+    BITMAP_RESULT_t storeRLE(const uint8_t *data, size_t length);
+    //expands length bytes of RLE data into dst, which has room for scanlineWidth * height bytes.
+    void expandRLE(const uint8_t *data, size_t length, uint8_t *dst);
+    //builds rleRows for RLE data that stays compressed, and the one row cache used to read it.
+    BITMAP_RESULT_t indexRLE(const uint8_t *data, size_t length);
+    //returns stored row of RLE data that was indexed by indexRLE, decoding it into the row cache if needed.
+    const uint8_t *rleRow(const uint8_t *data, int row);
+
+    //returns stored row of pixel data, or 0 if there isn't one. rows that aren't simply in colorData
+    //(RLE kept compressed, or pixel data left in a file) come from fetchRow.
+    const uint8_t *rowAt(int row) { return (colorData != 0 && rleRows == 0) ? colorData + scanlineWidth * row : fetchRow(row); }
+    virtual const uint8_t *fetchRow(int row);
+    void releaseRLE();
+
+    bool keepCompressed = false;
+    BITMAP_RLE_ROW_t *rleRows = 0;
+    uint8_t *rleScanline = 0;
+    int32_t rleCachedRow = -1;
+
+    //decode size set by setDecodeSize, and window set by setDecodeRect.
+    int32_t targetWidth = 0;
+    int32_t targetHeight = 0;
+    BITMAP_SCALE_t scaleFilter = BITMAP_SCALE_NEAREST;
+    int32_t cropX = 0;
+    int32_t cropY = 0;
+    int32_t cropWidth = 0;
+    int32_t cropHeight = 0;
+
+    //an image being cropped and/or reduced as it's decoded, the source rows are passed to scaleRow in stored order.
+    struct ScaleState {
+      int32_t x = 0;              //first source column of the window
+      int32_t firstRow = 0;       //first stored source row of the window
+      int32_t sourceWidth = 0;    //window size
+      int32_t sourceHeight = 0;
+      int32_t width = 0;          //reduced size
+      int32_t height = 0;
+      size_t scanlineWidth = 0;   //bytes per reduced row
+      int16_t bitsPerPixel = 0;   //of the reduced rows, the image's own or 24 for BITMAP_SCALE_BOX
+      uint16_t *columns = 0;      //nearest: source column of each reduced one. box: reduced column of each window one
+      uint16_t *columnCounts = 0; //box: source columns that make up each reduced one
+      uint32_t *sums = 0;         //box: blue, green and red totals of the reduced row being built
+      PIXEL_t *colors = 0;        //box: the window's part of one source row as colors
+      uint8_t *row = 0;           //reduced row being built
+      uint8_t *sourceRow = 0;     //a source row collected from pieces of a stream, or decoded from RLE
+      size_t sourceFill = 0;
+      int32_t sourceRows = 0;     //source rows seen so far
+      int32_t rowsSummed = 0;     //box: source rows in sums
+      int32_t nextRow = 0;        //next reduced row to store
+    };
+    ScaleState *scale = 0;
+
+    //sets up scale if a window or a decode size smaller than the image is set, called by beginImage once the headers are parsed.
+    BITMAP_RESULT_t beginScale();
+    //takes the next stored source row (scanlineWidth bytes as stored in the file).
+    void scaleRow(const uint8_t *scanline) { scaleRow(*scale, scanline); }
+    void scaleRow(ScaleState &state, const uint8_t *scanline);
+    //the first source row of the window that reduced row index is made from, sourceHeight past the last one.
+    int32_t firstSourceRow(const ScaleState &state, int32_t index);
+    //the uncompressed pixel data and a state for each worker.
+    struct ScaleJob {
+      const uint8_t *pixels;
+      ScaleState *states;
+    };
+    //reduces rows first to end - 1 of an uncompressed buffer, for one worker of scaleFileData, arg is a ScaleJob.
+    static void scaleRows(ESPBitmapBase *bitmap, void *arg, int32_t first, int32_t end, int worker);
+    //decodes length bytes of RLE data a row at a time into scaleRow.
+    void scaleRLE(const uint8_t *data, size_t length);
+    //reduces the pixel data of a whole file buffer.
+    BITMAP_RESULT_t scaleFileData(const uint8_t *wholeFileBytes, int32_t length);
+    //fills in any rows of the window that never arrived and switches width, height and the rest over to the reduced image.
+    BITMAP_RESULT_t endScale();
+    void releaseScale();
+
+    //the parts of reducing that depend on how each class stores its image. by default reduced rows are kept
+    //in colorData as is, and sourceRowColors has to turn count pixels of a raw source row into colors for BITMAP_SCALE_BOX.
+    virtual BITMAP_RESULT_t allocateScaled();
+    virtual void storeScaledRow(const uint8_t *row, int32_t index);
+    virtual void sourceRowColors(const uint8_t *scanline, int x0, int count, PIXEL_t *dst) = 0;
+
+    //getFromStream's parser, the bytes of the file are fed to it in order in pieces of any size.
+    struct LoadState {
+      uint8_t headers[BITMAP_MASKS_OFFSET]; //file and info header as they arrive
+      uint8_t masks[16];
+      uint8_t paletteEntry[4];
+      size_t offset = 0;        //bytes of the file parsed so far
+      size_t maskLength = 0;
+      size_t paletteOffset = 0;
+      size_t colorsToLoad = 0;
+      int32_t length = -1;      //of the whole file when the caller said, -1 if not
+      size_t pixelLength = 0;   //bytes of pixel data to store
+      uint8_t *compressed = 0;  //RLE data that gets expanded or reduced once it's all in
+      bool finished = false;
+    };
+    LoadState *load = 0;
+
+    BITMAP_RESULT_t beginLoad(int32_t length = -1);
+    //parses count more bytes of the file. once all the pixel data is in, load->finished is set.
+    BITMAP_RESULT_t feedLoad(const uint8_t *data, size_t count);
+    //reserves storage and sets up the palette and pixel data once the headers (and any masks) are in,
+    //what's needed depends on the masks (an alpha channel for one).
+    BITMAP_RESULT_t startLoadImage();
+    //ends the load, early if the data stopped coming. RLE data that ends early is fine, anything else is too short.
+    BITMAP_RESULT_t endLoad();
+    void releaseLoad();
+
+    //the parts of a load that depend on how each class stores its image.
+    virtual BITMAP_RESULT_t allocatePalette(size_t colors) = 0;
+    virtual void setPaletteColor(size_t index, const uint8_t *bgra) = 0;
+    //pixel data arrives in file order through storePixelData, by default it's kept in colorData as is.
+    virtual BITMAP_RESULT_t beginPixelData(size_t length);
+    virtual void storePixelData(const uint8_t *data, size_t offset, size_t count);
+    virtual BITMAP_RESULT_t endPixelData(size_t length);
+
+#ifdef ESP8266
+    ESPBitmapTransport *transport = 0;
+    //where the current image was fetched from and the validators the server sent with it.
+    String fetchedUrl;
+    String fetchedETag;
+    String fetchedLastModified;
+
+    //the stream being loaded by poll(), and how many bytes of it are left (-1 if unknown).
+    Stream *loadStream = 0;
+    int loadRemaining = -1;
+
+    //setPipeline, and getFromStream's reader and decoder sharing the ring.
+    int pipelineChunks = 0;
+    size_t pipelineChunkBytes = BITMAP_PIPELINE_CHUNK;
+    struct PipelineState;
+    BITMAP_RESULT_t pipelineFromStream(Stream* stream, int len, int timeoutMs);
+    static void pipelineJob(void *arg, int worker);
+
+    //blocking helpers for the stream decoders, they wait for bytes to become available
+    //and give up once timeoutMs has passed since startMs.
+    bool readStreamBytes(Stream* stream, uint8_t *dst, size_t count, unsigned long startMs, int timeoutMs);
+    bool skipStreamBytes(Stream* stream, size_t count, unsigned long startMs, int timeoutMs);
+
+    //RLE data read from a stream in small chunks, a chunk usually ends partway through a row.
+    struct StreamRLEState {
+      ESPBitmapRLE rle;
+      uint8_t chunk[32];
+      uint8_t used = 0;
+      uint8_t length = 0;
+      size_t remaining = 0; //compressed bytes still waiting in the stream
+      int32_t emptyRows = 0;
+    };
+    //decodes the next stored row of RLE data from the stream into scanline, scanlineWidth bytes.
+    bool readStreamRLERow(Stream* stream, StreamRLEState &state, uint8_t *scanline, unsigned long startMs, int timeoutMs);
 #endif //ESP8266
 };
 
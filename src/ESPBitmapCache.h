@@ -0,0 +1,186 @@
+/*
+ESPBitmap Library
+Copyright 2018 Rickey Ward
+
+MIT License
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom
+the Software is furnished to do so, subject to the following conditions: The
+above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED "AS
+IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ESPBITMAPCACHE_H_
+#define _ESPBITMAPCACHE_H_
+
+#include <inttypes.h>
+#include <string.h>
+#include "ESPBitmapBase.h"
+
+//decoded bitmaps kept by url or file path, so icons that are drawn over and over are only downloaded and
+//decoded once. the bitmaps together keep at most budgetBytes of storage (palette and pixel data, see
+//ESPBitmapBase::storageCapacity), the least recently used ones are dropped to make room.
+//Bitmap is ESPBitmap or ESPBitmap16.
+template<class Bitmap>
+class ESPBitmapCache
+{
+  public:
+    //loads key into bitmap, like bitmap.fetchImageFromUrl(key) or a DecodeFileBuffer of a file read from SD.
+    //it can call setDecodeSize and the rest on bitmap first.
+    typedef BITMAP_RESULT_t (*Loader)(const char *key, Bitmap &bitmap, void *context);
+
+    ESPBitmapCache(size_t budgetBytes) : budget(budgetBytes) {}
+    ~ESPBitmapCache() { clear(); }
+
+    //points bitmap at the one cached for key, loading it with load(key, bitmap, context) when it isn't.
+    //the pointer stays good until a later get misses, or remove, clear or setBudget is called.
+    //a failed load isn't cached. if the heap runs out while loading, cached bitmaps are dropped oldest first
+    //and it's tried again. a bitmap bigger than the whole budget is still returned, and is the first to go.
+    BITMAP_RESULT_t get(const char *key, Bitmap *&bitmap, Loader load, void *context = 0)
+    {
+      bitmap = 0;
+      Entry *entry = find(key);
+      if(entry != 0){
+        hits++;
+        entry->lastUsed = ++useCount;
+        bitmap = &entry->bitmap;
+        return BITMAP_SUCCESS;
+      }
+
+      misses++;
+      entry = new Entry();
+      if(entry == 0)
+        return BITMAP_ERROR_OUT_OF_MEMORY;
+      entry->key = new char[strlen(key) + 1];
+      if(entry->key == 0){
+        delete entry;
+        return BITMAP_ERROR_OUT_OF_MEMORY;
+      }
+      strcpy(entry->key, key);
+
+      BITMAP_RESULT_t result = load(entry->key, entry->bitmap, context);
+      while(result == BITMAP_ERROR_OUT_OF_MEMORY && evictOldest(0)){
+        entry->bitmap.reset(false);
+        result = load(entry->key, entry->bitmap, context);
+      }
+      if(result != BITMAP_SUCCESS){
+        delete[] entry->key;
+        delete entry;
+        return result;
+      }
+
+      entry->bytes = entry->bitmap.storageCapacity();
+      entry->lastUsed = ++useCount;
+      entry->next = entries;
+      entries = entry;
+      count++;
+      used += entry->bytes;
+      while(used > budget && evictOldest(entry));
+      bitmap = &entry->bitmap;
+      return BITMAP_SUCCESS;
+    }
+
+#ifdef ESP8266
+    //get with fetchImageFromUrl as the loader.
+    BITMAP_RESULT_t fetch(const String &url, Bitmap *&bitmap) { return get(url.c_str(), bitmap, loadUrl); }
+#endif
+
+    //drops key, so the next get loads it again. false if it wasn't cached.
+    bool remove(const char *key)
+    {
+      Entry *entry = find(key);
+      if(entry == 0)
+        return false;
+      drop(entry);
+      return true;
+    }
+
+    void clear()
+    {
+      while(entries != 0)
+        drop(entries);
+    }
+
+    //changes the budget, dropping bitmaps until they fit in it.
+    void setBudget(size_t budgetBytes)
+    {
+      budget = budgetBytes;
+      while(used > budget && evictOldest(0));
+    }
+
+    size_t budgetBytes() { return budget; }
+    //storage held by the cached bitmaps, and how many there are.
+    size_t bytesUsed() { return used; }
+    int entryCount() { return count; }
+
+    //gets answered from the cache, gets that had to load, and bitmaps dropped to stay in the budget.
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+
+  private:
+    struct Entry {
+      char *key = 0;
+      Bitmap bitmap;
+      size_t bytes = 0;
+      uint32_t lastUsed = 0;
+      Entry *next = 0;
+    };
+
+    Entry *find(const char *key)
+    {
+      for(Entry *entry = entries; entry != 0; entry = entry->next)
+        if(strcmp(entry->key, key) == 0)
+          return entry;
+      return 0;
+    }
+
+    //drops the least recently used bitmap other than keep, false if there's nothing else.
+    bool evictOldest(Entry *keep)
+    {
+      Entry *oldest = 0;
+      for(Entry *entry = entries; entry != 0; entry = entry->next)
+        if(entry != keep && (oldest == 0 || entry->lastUsed < oldest->lastUsed))
+          oldest = entry;
+      if(oldest == 0)
+        return false;
+      drop(oldest);
+      evictions++;
+      return true;
+    }
+
+    void drop(Entry *entry)
+    {
+      Entry **link = &entries;
+      while(*link != entry)
+        link = &(*link)->next;
+      *link = entry->next;
+      used -= entry->bytes;
+      count--;
+      delete[] entry->key;
+      delete entry;
+    }
+
+#ifdef ESP8266
+    static BITMAP_RESULT_t loadUrl(const char *key, Bitmap &bitmap, void *) {
+      return bitmap.fetchImageFromUrl(String(key));
+    }
+#endif
+
+    Entry *entries = 0;
+    size_t budget;
+    size_t used = 0;
+    int count = 0;
+    uint32_t useCount = 0;
+};
+
+#endif /*_ESPBITMAPCACHE_H_*/
@@ -0,0 +1,191 @@
+/*
+ESPBitmap Library
+Copyright 2018 Rickey Ward
+
+MIT License
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom
+the Software is furnished to do so, subject to the following conditions: The
+above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED "AS
+IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include "ESPBitmapFile.h"
+
+//Serial debug output is compiled out unless ESPBITMAP_DEBUG is defined when building the library.
+#ifdef ESPBITMAP_DEBUG
+ #define DEBUG
+#endif
+
+#ifdef DEBUG
+ #define DEBUG_PRINT(x) Serial.print(x)
+ #define DEBUG_PRINTLN(x) Serial.println(x)
+#else
+ #define DEBUG_PRINT(x)
+ #define DEBUG_PRINTLN(x) 
+#endif
+
+ESPBitmapFile::ESPBitmapFile(){
+  DEBUG_PRINTLN(F("Construct ESPBitmapFile Object"));
+}
+
+ESPBitmapFile::~ESPBitmapFile(){
+  DEBUG_PRINTLN(F("Deconstruct ESPBitmapFile Object"));
+}
+
+void ESPBitmapFile::setCacheRows(int rows)
+{
+    cacheRows = rows > 0 ? (rows < 0x7FFF ? rows : 0x7FFF) : 1;
+}
+
+BITMAP_RESULT_t ESPBitmapFile::open(ESPBitmapSource *from)
+{
+    //a new file replaces whatever was open, in the same memory when it fits.
+    reset();
+    BITMAP_STAT(resetStats());
+
+    //get and validate the headers
+    uint8_t headers[BITMAP_MASKS_OFFSET];
+    if(!from->readAt(0, headers, sizeof(headers)))
+      return BITMAP_ERROR_TOO_SHORT;
+    BITMAP_FILE_HEADER_t bitmapHeader;
+    BITMAP_INFO_HEADER_t bitmapInfo;
+    memcpy(&bitmapHeader, headers, sizeof(BITMAP_FILE_HEADER_t));
+    memcpy(&bitmapInfo, headers + sizeof(BITMAP_FILE_HEADER_t), sizeof(BITMAP_INFO_HEADER_t));
+    size_t colorsToLoad = 0;
+    BITMAP_RESULT_t headerResult = parseHeaders(bitmapHeader, bitmapInfo, colorsToLoad);
+    if(headerResult != BITMAP_SUCCESS)
+      return headerResult;
+    if(isRLE())
+      return BITMAP_ERROR_UNSUPPORTED_COMPRESSION;
+
+    size_t maskLength = maskBytes(bitmapInfo);
+    size_t paletteOffset = sizeof(BITMAP_FILE_HEADER_t) + bitmapInfo.headerSize;
+    if(BITMAP_MASKS_OFFSET + maskLength > (size_t)dataOffset || paletteOffset + colorsToLoad * 4 > (size_t)dataOffset)
+      return BITMAP_ERROR_TOO_SHORT;
+    //the last byte of pixel data has to be there, so every row can be read later.
+    data_length = scanlineWidth * height;
+    uint8_t last;
+    if(!from->readAt(dataOffset + data_length - 1, &last, 1))
+      return BITMAP_ERROR_TOO_SHORT;
+    BITMAP_STAT(statPhase(stats.headerMicros));
+
+    //the palette and the cache share one block.
+    BITMAP_RESULT_t storageResult = reserveStorage(storageNeeded(colorsToLoad, 0, false));
+    if(storageResult != BITMAP_SUCCESS)
+      return storageResult;
+
+    if(maskLength > 0){
+      uint8_t masks[16];
+      if(!from->readAt(BITMAP_MASKS_OFFSET, masks, maskLength))
+        return BITMAP_ERROR_TOO_SHORT;
+      loadChannelMasks(masks, maskLength);
+    }
+
+    //the palette is read a few entries at a time, every read can be a seek on an SD card.
+    if(colorsToLoad > 0){
+      BITMAP_RESULT_t paletteResult = allocatePalette(colorsToLoad);
+      if(paletteResult != BITMAP_SUCCESS)
+        return paletteResult;
+      uint8_t entries[64];
+      for(size_t i = 0; i < colorsToLoad; i += sizeof(entries) / 4){
+        size_t count = colorsToLoad - i;
+        if(count > sizeof(entries) / 4)
+          count = sizeof(entries) / 4;
+        if(!from->readAt(paletteOffset + 4 * i, entries, 4 * count))
+          return BITMAP_ERROR_TOO_SHORT;
+        for(size_t j = 0; j < count; j++)
+          setPaletteColor(i + j, entries + 4 * j);
+      }
+    }
+    BITMAP_STAT(statPhase(stats.paletteMicros));
+
+    cache = (uint8_t *)takeStorage(cacheRows * scanlineWidth);
+    cachedRows = (int32_t *)takeStorage(cacheRows * sizeof(int32_t));
+    lastUsed = (uint32_t *)takeStorage(cacheRows * sizeof(uint32_t));
+    rowSlots = (int16_t *)takeStorage(height * sizeof(int16_t));
+    if(cache == 0 || cachedRows == 0 || lastUsed == 0 || rowSlots == 0){
+      clearImage();
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    }
+    for(int i = 0; i < cacheRows; i++){
+      cachedRows[i] = -1;
+      lastUsed[i] = 0;
+    }
+    for(int32_t row = 0; row < height; row++)
+      rowSlots[row] = -1;
+    useCount = 0;
+    cacheHits = 0;
+    cacheMisses = 0;
+
+    source = from;
+    return BITMAP_SUCCESS;
+}
+
+const uint8_t *ESPBitmapFile::fetchRow(int row)
+{
+    if(source == 0)
+      return ESPBitmap::fetchRow(row);
+    if(row < 0 || row >= height)
+      return 0;
+
+    int slot = rowSlots[row];
+    if(slot >= 0){
+      cacheHits++;
+      lastUsed[slot] = ++useCount;
+      return cache + scanlineWidth * slot;
+    }
+
+    //the least recently used row makes room for it.
+    slot = 0;
+    for(int i = 1; i < cacheRows; i++)
+      if(lastUsed[i] < lastUsed[slot])
+        slot = i;
+    if(cachedRows[slot] >= 0)
+      rowSlots[cachedRows[slot]] = -1;
+
+    cacheMisses++;
+    uint8_t *scanline = cache + scanlineWidth * slot;
+    if(!source->readAt(dataOffset + scanlineWidth * row, scanline, scanlineWidth)){
+      cachedRows[slot] = -1;
+      lastUsed[slot] = 0;
+      return 0;
+    }
+    BITMAP_STAT(stats.bytesRead += scanlineWidth);
+    BITMAP_STAT(stats.readCalls++);
+    cachedRows[slot] = row;
+    rowSlots[row] = slot;
+    lastUsed[slot] = ++useCount;
+    return scanline;
+}
+
+size_t ESPBitmapFile::storageNeeded(size_t colors, size_t /*pixelLength*/, bool /*borrowed*/)
+{
+    //no pixel data is kept, just the palette (and its expand table) and the cache.
+    return storageBytes(paletteEntries(colors) * sizeof(PIXEL_t))
+      + storageBytes(colors > 0 ? expandTableSize(bitsPerPixel) * sizeof(PIXEL_t) : 0)
+      + storageBytes(cacheRows * scanlineWidth)
+      + storageBytes(cacheRows * sizeof(int32_t))
+      + storageBytes(cacheRows * sizeof(uint32_t))
+      + storageBytes(height * sizeof(int16_t));
+}
+
+void ESPBitmapFile::clearImage()
+{
+    cache = 0;
+    cachedRows = 0;
+    lastUsed = 0;
+    rowSlots = 0;
+    source = 0;
+    ESPBitmap::clearImage();
+}
@@ -0,0 +1,103 @@
+/*
+ESPBitmap Library
+Copyright 2018 Rickey Ward
+
+MIT License
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom
+the Software is furnished to do so, subject to the following conditions: The
+above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED "AS
+IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ESPBITMAPFILE_H_
+#define _ESPBITMAPFILE_H_
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "ESPBitmap.h"
+
+//random access to the bytes of a bitmap file that stays where it is (SD card, SPIFFS, a file on a PC...).
+class ESPBitmapSource
+{
+  public:
+    virtual ~ESPBitmapSource() {}
+    //reads count bytes starting at offset into dst, false if they couldn't all be read.
+    virtual bool readAt(uint32_t offset, uint8_t *dst, size_t count) = 0;
+};
+
+//an ESPBitmapSource for any file class with seek(position) and read(buffer, count),
+//like the SD library's File or the ESP8266 core's fs::File.
+template<class FileT>
+class ESPBitmapFileSource : public ESPBitmapSource
+{
+  public:
+    ESPBitmapFileSource(FileT &opened) : file(opened) {}
+    bool readAt(uint32_t offset, uint8_t *dst, size_t count) {
+      return file.seek(offset) && (size_t)file.read(dst, count) == count;
+    }
+
+  private:
+    FileT &file;
+};
+
+//an ESPBitmapSource for a stdio FILE, mostly for trying things out on a PC.
+class ESPBitmapStdioSource : public ESPBitmapSource
+{
+  public:
+    ESPBitmapStdioSource(FILE *opened) : file(opened) {}
+    bool readAt(uint32_t offset, uint8_t *dst, size_t count) {
+      return fseek(file, offset, SEEK_SET) == 0 && fread(dst, 1, count, file) == count;
+    }
+
+  private:
+    FILE *file;
+};
+
+//an ESPBitmap whose pixel data is left in a file instead of being loaded, for images much bigger than ram.
+//only the headers and palette are read up front, rows are read as getPixel, copyRow and copyRect need them
+//and the most recently used ones are kept in a small cache.
+class ESPBitmapFile : public ESPBitmap
+{
+  public:
+    ESPBitmapFile();
+    ~ESPBitmapFile();
+
+    //number of scanlines kept in ram (4 by default, at most 32767), call before open. each costs scanlineWidth bytes,
+    //more of them let drawing go back and forth between nearby rows without reading them again.
+    //finding a row in the cache takes a table of 2 bytes per image row.
+    void setCacheRows(int rows);
+
+    //reads the headers and palette from source, which has to stay open for as long as the bitmap is used.
+    //RLE images can't be read a row at a time without decoding everything before it, and aren't supported.
+    BITMAP_RESULT_t open(ESPBitmapSource *source);
+
+    //rows found in the cache and rows read from the source, since open.
+    uint32_t cacheHits = 0;
+    uint32_t cacheMisses = 0;
+
+  protected:
+    const uint8_t *fetchRow(int row);
+    size_t storageNeeded(size_t colors, size_t pixelLength, bool borrowed);
+    void clearImage();
+
+  private:
+    ESPBitmapSource *source = 0;
+    int cacheRows = 4;
+    uint8_t *cache = 0;         //cacheRows scanlines
+    int32_t *cachedRows = 0;    //stored row held by each one, -1 for none
+    int16_t *rowSlots = 0;      //the other way around, which one holds each stored row, -1 for none
+    uint32_t *lastUsed = 0;     //when each one was last used, the oldest is replaced
+    uint32_t useCount = 0;
+};
+
+#endif /*_ESPBITMAPFILE_H_*/
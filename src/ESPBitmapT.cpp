@@ -0,0 +1,1513 @@
+/*
+ESPBitmap Library
+Copyright 2018 Rickey Ward
+
+MIT License
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom
+the Software is furnished to do so, subject to the following conditions: The
+above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED "AS
+IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include <Arduino.h>
+#include "ESPBitmapT.h"
+#include <pins_arduino.h>
+
+#ifdef ESP8266
+#include <ESP8266HTTPClient.h>
+#include <stream.h>
+#endif
+
+//Serial debug output is compiled out unless ESPBITMAP_DEBUG is defined when building the library,
+//ESPBITMAP_DEBUG_FINE adds the very chatty per chunk output of the stream parsers.
+#ifdef ESPBITMAP_DEBUG
+ #define DEBUG
+#endif
+#ifdef ESPBITMAP_DEBUG_FINE
+ #define DEBUG_FINE
+#endif
+//#define FAST_AND_LOOSE  //skip some error checking and risk undesirable behavior for speed.
+
+#ifdef DEBUG
+ #define DEBUG_PRINT(x) Serial.print(x)
+ #define DEBUG_PRINTLN(x) Serial.println(x)
+#else
+ #define DEBUG_PRINT(x)
+ #define DEBUG_PRINTLN(x)
+#endif
+
+#ifdef DEBUG_FINE
+ #define DEBUG_FINE_PRINT(x) Serial.print(x)
+ #define DEBUG_FINE_PRINTLN(x) Serial.println(x)
+#else
+ #define DEBUG_FINE_PRINT(x)
+ #define DEBUG_FINE_PRINTLN(x)
+#endif
+
+//------------------------------------------------------------------ RGB565 conversions
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+//a whole 32 bit word from a word aligned address, a single load even on the ESP8266 (which can't do unaligned ones).
+static inline uint32_t loadAlignedWord(const uint8_t *src){
+  uint32_t word;
+  memcpy(&word, __builtin_assume_aligned(src, 4), sizeof(word));
+  return word;
+}
+#endif
+
+//BGR to RGB565 four pixels at a time: three word loads, then the channels of each pixel are
+//masked and shifted into place straight out of the words (SWAR), no byte loads or Color() calls.
+void PixelRGB565::fromBGR24(const uint8_t *src, int count, uint16_t *dst){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  //pixels are 3 bytes, so at most 3 of them get src onto a word boundary, and 4 pixels keep it there.
+  for(; count > 0 && ((uintptr_t)src & 3); count--, src += 3)
+    *dst++ = ESPBitmapBase::Color(src[2], src[1], src[0]);
+
+  for(; count >= 4; count -= 4, src += 12, dst += 4){
+    uint32_t w0 = loadAlignedWord(src);     //b0 g0 r0 b1
+    uint32_t w1 = loadAlignedWord(src + 4); //g1 r1 b2 g2
+    uint32_t w2 = loadAlignedWord(src + 8); //r2 b3 g3 r3
+    dst[0] = ((w0 >> 8) & 0xF800) | ((w0 >> 5) & 0x07E0) | ((w0 >> 3) & 0x001F);
+    dst[1] = (w1 & 0xF800) | ((w1 << 3) & 0x07E0) | (w0 >> 27);
+    dst[2] = ((w2 << 8) & 0xF800) | ((w1 >> 21) & 0x07E0) | ((w1 >> 19) & 0x001F);
+    dst[3] = ((w2 >> 16) & 0xF800) | ((w2 >> 13) & 0x07E0) | ((w2 >> 11) & 0x001F);
+  }
+#endif
+  for(; count > 0; count--, src += 3)
+    *dst++ = ESPBitmapBase::Color(src[2], src[1], src[0]);
+}
+
+//BGRX to RGB565, a word load per pixel when src is word aligned.
+void PixelRGB565::fromBGRA32(const uint8_t *src, int count, uint16_t *dst, bool /*hasAlpha*/){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if(((uintptr_t)src & 3) == 0){
+    for(; count > 0; count--, src += 4){
+      uint32_t w = loadAlignedWord(src);
+      *dst++ = ((w >> 8) & 0xF800) | ((w >> 5) & 0x07E0) | ((w >> 3) & 0x001F);
+    }
+    return;
+  }
+#endif
+  for(; count > 0; count--, src += 4)
+    *dst++ = ESPBitmapBase::Color(src[2], src[1], src[0]);
+}
+
+//an RGB565 file is already what we store (little endian like the ESP), so it's copied as is.
+void PixelRGB565::fromRGB565(const uint8_t *src, int count, uint16_t *dst){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  memcpy(dst, src, count * sizeof(uint16_t));
+#else
+  for(; count > 0; count--, src += 2)
+    *dst++ = src[0] | (src[1] << 8);
+#endif
+}
+
+//the swapped ones convert the same way, then turn the words around while they're still in cache.
+static void swapWords(uint16_t *dst, int count){
+  for(; count > 0; count--, dst++)
+    *dst = PixelRGB565Swapped::swap(*dst);
+}
+
+void PixelRGB565Swapped::fromBGR24(const uint8_t *src, int count, uint16_t *dst){
+  PixelRGB565::fromBGR24(src, count, dst);
+  swapWords(dst, count);
+}
+
+void PixelRGB565Swapped::fromBGRA32(const uint8_t *src, int count, uint16_t *dst, bool hasAlpha){
+  PixelRGB565::fromBGRA32(src, count, dst, hasAlpha);
+  swapWords(dst, count);
+}
+
+void PixelRGB565Swapped::fromRGB565(const uint8_t *src, int count, uint16_t *dst){
+  for(; count > 0; count--, src += 2)
+    *dst++ = (src[0] << 8) | src[1];
+}
+
+//------------------------------------------------------------------ ESPBitmapT
+
+template<class Format>
+ESPBitmapT<Format>::ESPBitmapT(){
+  DEBUG_PRINTLN(F("Construct ESPBitmapT Object"));
+  ERROR_COLOR = Format::fromRGBA(255, 0, 255, 0);
+  width = 0;
+  height = 0;
+}
+
+template<class Format>
+ESPBitmapT<Format>::~ESPBitmapT(){
+  DEBUG_PRINTLN(F("Deconstruct ESPBitmapT Object"));
+  if(loadScanline != 0)
+    delete[]  loadScanline;
+}
+
+template<class Format>
+BITMAP_RESULT_t ESPBitmapT<Format>::DecodeFileBuffer(uint8_t *wholeFileBytes, int32_t length)
+{
+    //a new image replaces whatever was loaded, in the same memory when it fits.
+    reset();
+    BITMAP_STAT(resetStats());
+
+    //get and validate the headers
+    BITMAP_FILE_HEADER_t bitmapHeader;
+    BITMAP_INFO_HEADER_t bitmapInfo;
+    size_t colorsToLoad = 0;
+    BITMAP_RESULT_t headerResult = parseFileBuffer(wholeFileBytes, length, bitmapHeader, bitmapInfo, colorsToLoad);
+    if(headerResult != BITMAP_SUCCESS)
+      return headerResult;
+    if(premultiply && bitsPerPixel == 32 && compression == BI_UNCOMPRESSED)
+      alphaBytes = findAlphaBytes(wholeFileBytes + dataOffset, length - dataOffset);
+    BITMAP_STAT(statPhase(stats.headerMicros));
+
+    //reduced row by row when a decode size or rect is set, and all the memory the image keeps is reserved in one go.
+    //pixels converted as they load can't be borrowed.
+    //nor can pixels that get premultiplied.
+    bool converted = convertsPixels();
+    BITMAP_RESULT_t dataResult = beginImage(colorsToLoad, data_length, borrowBuffer && !converted && !premultiplies() && (!isRLE() || keepCompressed));
+    if(dataResult != BITMAP_SUCCESS)
+      return dataResult;
+
+    //if we need a palette, load it.
+    if(colorsToLoad > 0){
+      dataResult = allocatePalette(colorsToLoad);
+      if(dataResult != BITMAP_SUCCESS)
+        return dataResult;
+
+      for(size_t i = 0; i < colorsToLoad; i++){
+        int index = (sizeof(BITMAP_FILE_HEADER_t) /* should be 14 */ + bitmapInfo.headerSize) + (4 * i); //pallate of supported types starts at 54 but header could have other stuff
+        setPaletteColor(i, wholeFileBytes + index);
+      }
+    }
+
+    BITMAP_STAT(statPhase(stats.paletteMicros));
+
+    //load all the color data, keeping it in whatever format it was in.
+    //we don't want to parse it into pure colors, because we want to save all the ram we can.
+    //it's reduced when a decode size or rect is set, otherwise copied, or borrowed when setBorrowBuffer(true)
+    //was called. RLE data is expanded or indexed.
+    //16, 24 and 32bpp images are converted to Format (or quantized) once here when it's one that converts,
+    //so reading them back later is just a lookup.
+    if(scale == 0 && converted){
+      if(dataOffset + scanlineWidth * height > (size_t)length)
+        return BITMAP_ERROR_TOO_SHORT;
+      dataResult = allocateConverted(width, height);
+      if(dataResult != BITMAP_SUCCESS)
+        return dataResult;
+    }
+    //a median cut palette is made from every pixel of the file before any of them are quantized.
+    if(quantizePalette != 0 && quantize == BITMAP_QUANTIZE_MEDIAN_CUT && bitsPerPixel >= 16 && !isRLE()
+       && dataOffset + scanlineWidth * height <= (size_t)length)
+      medianCut(wholeFileBytes + dataOffset);
+    if(scale != 0)
+      dataResult = scaleFileData(wholeFileBytes, length);
+    else if(converted)
+      runRows(height, rowWorkers(height), convertRows, wholeFileBytes + dataOffset);
+    else
+      dataResult = storeFileData(wholeFileBytes, length);
+    if(dataResult == BITMAP_SUCCESS)
+      dataResult = premultiplyImage();
+    if(dataResult != BITMAP_SUCCESS)
+      return dataResult;
+    endQuantize();
+    repackImage();
+
+    //now we have all the data loaded in colorData (or pixelData) and the palette loaded if needed.
+    BITMAP_STAT(statPhase(stats.dataMicros));
+    return BITMAP_SUCCESS;
+}
+
+template<class Format>
+bool ESPBitmapT<Format>::convertsPixels()
+{
+    //paletted images reduced by picking pixels keep their indexes, box filtered ones are BGR by then.
+    //premultiplied ones stay 32bpp so they keep their alpha.
+    if(premultiplies())
+      return false;
+    if(quantizes())
+      return true;
+    //dithered paletted images, and ones of more bits than a packed format's, are unpacked from RLE by then when
+    //they're reduced, otherwise only the kept compressed ones can't be read a scanline at a time.
+    bool packs = Format::bits < 8 && bitsPerPixel > Format::bits;
+    if((dithers() || packs) && (scale != 0 || !isRLE()))
+      return true;
+    if(!Format::convertDirect)
+      return false;
+    if(scale != 0 && scaleFilter == BITMAP_SCALE_BOX)
+      return true;
+    return bitsPerPixel >= 16;
+}
+
+//how a converted row holds its pixels: one Pixel after another, or for formats of less than 8 bits
+//packed into bytes with the first pixel in the high bits. picked at compile time.
+template<class Format, bool packed = (Format::bits < 8)>
+struct ConvertedRow
+{
+  typedef typename Format::Pixel Pixel;
+  static void store(const Pixel *src, int x0, int count, uint8_t *row) {
+    memcpy(row + x0 * sizeof(Pixel), src, count * sizeof(Pixel));
+  }
+  static void read(const uint8_t *row, int x0, int count, Pixel *dst) {
+    memcpy(dst, row + x0 * sizeof(Pixel), count * sizeof(Pixel));
+  }
+  //only packed formats dither.
+  static void dither(const uint8_t *, int, int, int32_t, uint8_t *) {}
+};
+
+//the 4x4 Bayer matrix, the order the 16 thresholds between two levels are crossed in.
+static const uint8_t bayer4[4][4] = {
+  {  0,  8,  2, 10 },
+  { 12,  4, 14,  6 },
+  {  3, 11,  1,  9 },
+  { 15,  7, 13,  5 }
+};
+
+template<class Format>
+struct ConvertedRow<Format, true>
+{
+  typedef typename Format::Pixel Pixel;
+  static void store(const Pixel *src, int x0, int count, uint8_t *row) {
+    for(int x = x0; x < x0 + count; x++){
+      int bit = x * Format::bits;
+      uint8_t shift = 8 - Format::bits - (bit & 7);
+      uint8_t mask = ((1 << Format::bits) - 1) << shift;
+      row[bit >> 3] = (row[bit >> 3] & ~mask) | ((*src++ << shift) & mask);
+    }
+  }
+  static void read(const uint8_t *row, int x0, int count, Pixel *dst) {
+    for(int x = x0; x < x0 + count; x++){
+      int bit = x * Format::bits;
+      *dst++ = (row[bit >> 3] >> (8 - Format::bits - (bit & 7))) & ((1 << Format::bits) - 1);
+    }
+  }
+  //stores count lumas as the level below them, or the one above when the part of the way there is past
+  //the pixel's threshold in the Bayer matrix.
+  static void dither(const uint8_t *luma, int x0, int count, int32_t y, uint8_t *row) {
+    const int levels = (1 << Format::bits) - 1;
+    const uint8_t *thresholds = bayer4[y & 3];
+    for(int x = x0; x < x0 + count; x++){
+      int v = *luma++ * levels;
+      int level = v / 255;
+      if((v - level * 255) * 16 > thresholds[x & 3] * 255 + 127)
+        level++;
+      int bit = x * Format::bits;
+      uint8_t shift = 8 - Format::bits - (bit & 7);
+      row[bit >> 3] = (row[bit >> 3] & ~(levels << shift)) | (level << shift);
+    }
+  }
+};
+
+template<class Format>
+void ESPBitmapT<Format>::convertRow(const uint8_t *raw, bool bgr, int32_t y, int count, uint8_t *dst)
+{
+    if(quantizePalette != 0){
+      quantizeRow(raw, bgr, count, dst);
+      return;
+    }
+    if(dithers()){
+      ditherRow(raw, bgr, y, count, dst);
+      return;
+    }
+    if(Format::bits >= 8){
+      if(bgr)
+        Format::fromBGR24(raw, count, (Pixel *)dst);
+      else
+        expandScanline(raw, palette, 0, count, (Pixel *)dst);
+      return;
+    }
+
+    //packed formats go through a few pixels at a time.
+    Pixel run[32];
+    for(int x = 0; x < count; x += 32){
+      int n = count - x < 32 ? count - x : 32;
+      if(bgr)
+        Format::fromBGR24(raw + 3 * x, n, run);
+      else
+        expandScanline(raw, palette, x, n, run);
+      ConvertedRow<Format>::store(run, x, n, dst);
+    }
+}
+
+template<class Format>
+void ESPBitmapT<Format>::ditherRow(const uint8_t *raw, bool bgr, int32_t y, int count, uint8_t *dst)
+{
+    //the luma of a few pixels at a time, from the file's own colors.
+    uint8_t luma[32];
+    for(int x = 0; x < count; x += 32){
+      int n = count - x < 32 ? count - x : 32;
+      if(bgr)
+        PixelGray8::fromBGR24(raw + 3 * x, n, luma);
+      else if(bitsPerPixel >= 16)
+        expandDirect<PixelGray8>(raw, x, n, luma);
+      else{
+        int bits = bitsPerPixel;
+        for(int i = 0; i < n; i++){
+          int bit = (x + i) * bits;
+          luma[i] = paletteLuma[(raw[bit >> 3] >> (8 - bits - (bit & 7))) & ((1 << bits) - 1)];
+        }
+      }
+      ConvertedRow<Format>::dither(luma, x, n, y, dst);
+    }
+}
+
+template<class Format>
+void ESPBitmapT<Format>::convertRows(ESPBitmapBase *bitmap, void *arg, int32_t first, int32_t end, int /*worker*/)
+{
+    ESPBitmapT &image = *(ESPBitmapT *)bitmap;
+    const uint8_t *pixels = (const uint8_t *)arg;
+    for(int32_t row = first; row < end; row++)
+      image.convertRow(pixels + image.scanlineWidth * row, false, row, image.width, image.pixelData + image.pixelRowBytes * row);
+}
+
+template<class Format>
+void ESPBitmapT<Format>::readConverted(const uint8_t *row, int x0, int count, Pixel *dst)
+{
+    ConvertedRow<Format>::read(row, x0, count, dst);
+}
+
+template<class Format>
+BITMAP_RESULT_t ESPBitmapT<Format>::allocateConverted(int32_t w, int32_t h)
+{
+    //quantized rows are padded like the 8bpp scanlines they become.
+    bool quantized = quantizes();
+    pixelRowBytes = quantized ? 4 * ((w + 3) / 4) : (w * Format::bits + 7) / 8;
+    pixelData = (uint8_t *)takeStorage(pixelRowBytes * h);
+    if(pixelData == 0)
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    if(!quantized)
+      return BITMAP_SUCCESS;
+
+    //332 until a median cut replaces it, each index is rrrgggbb.
+    quantizePalette = (Pixel *)takeStorage(256 * sizeof(Pixel));
+    if(quantizePalette == 0)
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    quantizeColors = 256;
+    for(int i = 0; i < 256; i++)
+      quantizePalette[i] = Format::fromRGBA((i >> 5) * 255 / 7, ((i >> 2) & 0x07) * 255 / 7, (i & 0x03) * 255 / 3, 0);
+    return BITMAP_SUCCESS;
+}
+
+template<class Format>
+bool ESPBitmapT<Format>::quantizes()
+{
+    //formats of 8 bits or less take no more memory than the indexes would.
+    if(quantize == BITMAP_QUANTIZE_OFF || Format::bits <= 8)
+      return false;
+    if(scale != 0 && scaleFilter == BITMAP_SCALE_BOX)
+      return true;
+    return bitsPerPixel >= 16;
+}
+
+template<class Format>
+void ESPBitmapT<Format>::quantizeRow(const uint8_t *raw, bool bgr, int count, uint8_t *dst)
+{
+    //a few colors at a time, straight from the file so nothing is lost to Format on the way.
+    PIXEL_t colors[32];
+    for(int x = 0; x < count; x += 32){
+      int n = count - x < 32 ? count - x : 32;
+      if(bgr)
+        PixelRGB888::fromBGR24(raw + 3 * x, n, colors);
+      else
+        expandDirect<PixelRGB888>(raw, x, n, colors);
+      if(quantizeMap != 0){
+        for(int i = 0; i < n; i++)
+          dst[x + i] = quantizeMap[((colors[i].r >> 4) << 8) | ((colors[i].g >> 4) << 4) | (colors[i].b >> 4)];
+      }
+      else{
+        for(int i = 0; i < n; i++)
+          dst[x + i] = (colors[i].r & 0xE0) | ((colors[i].g >> 3) & 0x1C) | (colors[i].b >> 6);
+      }
+    }
+}
+
+//a box of the 16 x 16 x 16 color histogram medianCut splits up. the boxes always cover the whole cube
+//between them, so every color has an index, and tight bounds the colors actually in each one.
+struct MedianCutBox
+{
+  uint8_t lo[3];
+  uint8_t hi[3];
+  uint8_t tightLo[3];
+  uint8_t tightHi[3];
+  uint32_t count;
+};
+
+static inline int medianCutBin(int r, int g, int b) { return (r << 8) | (g << 4) | b; }
+
+//fills in a box's count and tight bounds from the histogram.
+static void medianCutShrink(MedianCutBox &box, const uint16_t *bins)
+{
+  box.count = 0;
+  for(int c = 0; c < 3; c++){
+    box.tightLo[c] = 15;
+    box.tightHi[c] = 0;
+  }
+  for(int r = box.lo[0]; r <= box.hi[0]; r++)
+    for(int g = box.lo[1]; g <= box.hi[1]; g++)
+      for(int b = box.lo[2]; b <= box.hi[2]; b++){
+        uint16_t n = bins[medianCutBin(r, g, b)];
+        if(n == 0)
+          continue;
+        box.count += n;
+        uint8_t v[3] = { (uint8_t)r, (uint8_t)g, (uint8_t)b };
+        for(int c = 0; c < 3; c++){
+          if(v[c] < box.tightLo[c])
+            box.tightLo[c] = v[c];
+          if(v[c] > box.tightHi[c])
+            box.tightHi[c] = v[c];
+        }
+      }
+}
+
+template<class Format>
+void ESPBitmapT<Format>::medianCut(const uint8_t *pixels)
+{
+    //counts of 4 bits a channel colors, halved (never to 0) when one of them fills up.
+    uint16_t *bins = new uint16_t[4096];
+    MedianCutBox *boxes = new MedianCutBox[256];
+    if(bins == 0 || boxes == 0){
+      delete[] bins;
+      delete[] boxes;
+      return;
+    }
+    BITMAP_STAT(statAllocated(4096 * sizeof(uint16_t) + 256 * sizeof(MedianCutBox)));
+    memset(bins, 0, 4096 * sizeof(uint16_t));
+    PIXEL_t colors[32];
+    for(int32_t row = 0; row < height; row++){
+      const uint8_t *scanline = pixels + scanlineWidth * row;
+      for(int x = 0; x < width; x += 32){
+        int n = width - x < 32 ? width - x : 32;
+        expandDirect<PixelRGB888>(scanline, x, n, colors);
+        for(int i = 0; i < n; i++){
+          uint16_t &bin = bins[((colors[i].r >> 4) << 8) | ((colors[i].g >> 4) << 4) | (colors[i].b >> 4)];
+          if(bin == 0xFFFF){
+            for(int j = 0; j < 4096; j++)
+              bins[j] = (bins[j] + 1) >> 1;
+          }
+          bin++;
+        }
+      }
+    }
+
+    //keep splitting the box with the most pixels times its longest side, at the median of that side.
+    int count = 1;
+    for(int c = 0; c < 3; c++){
+      boxes[0].lo[c] = 0;
+      boxes[0].hi[c] = 15;
+    }
+    medianCutShrink(boxes[0], bins);
+    while(count < 256){
+      int pick = -1;
+      int axis = 0;
+      uint64_t best = 0;
+      for(int i = 0; i < count; i++){
+        for(int c = 0; c < 3; c++){
+          uint32_t side = boxes[i].tightHi[c] - boxes[i].tightLo[c];
+          if(side > 0 && (uint64_t)boxes[i].count * (side + 1) > best){
+            best = (uint64_t)boxes[i].count * (side + 1);
+            pick = i;
+            axis = c;
+          }
+        }
+      }
+      if(pick < 0)
+        break;
+
+      //counts of each slice across the axis, the cut goes after the one that reaches half.
+      MedianCutBox &box = boxes[pick];
+      uint32_t slices[16] = { 0 };
+      for(int r = box.lo[0]; r <= box.hi[0]; r++)
+        for(int g = box.lo[1]; g <= box.hi[1]; g++)
+          for(int b = box.lo[2]; b <= box.hi[2]; b++)
+            slices[axis == 0 ? r : axis == 1 ? g : b] += bins[medianCutBin(r, g, b)];
+      int cut = box.tightLo[axis];
+      uint32_t below = slices[cut];
+      while(cut + 1 < box.tightHi[axis] && below * 2 < box.count)
+        below += slices[++cut];
+
+      MedianCutBox &upper = boxes[count++];
+      upper = box;
+      upper.lo[axis] = cut + 1;
+      box.hi[axis] = cut;
+      medianCutShrink(box, bins);
+      medianCutShrink(upper, bins);
+    }
+
+    //the bins become the index of their box, then each color is the average of the file's pixels that map to it.
+    for(int i = 0; i < count; i++){
+      const MedianCutBox &box = boxes[i];
+      for(int r = box.lo[0]; r <= box.hi[0]; r++)
+        for(int g = box.lo[1]; g <= box.hi[1]; g++)
+          for(int b = box.lo[2]; b <= box.hi[2]; b++)
+            bins[medianCutBin(r, g, b)] = i;
+    }
+    delete[] boxes;
+    BITMAP_STAT(statFreed(256 * sizeof(MedianCutBox)));
+
+    //red, green, blue and count for each, the sums stop growing once there are plenty of pixels to go by.
+    //without the memory for them it stays 332.
+    uint32_t *sums = new uint32_t[256 * 4];
+    if(sums == 0){
+      delete[] bins;
+      BITMAP_STAT(statFreed(4096 * sizeof(uint16_t)));
+      return;
+    }
+    BITMAP_STAT(statAllocated(256 * 4 * sizeof(uint32_t)));
+    memset(sums, 0, 256 * 4 * sizeof(uint32_t));
+    for(int32_t row = 0; row < height; row++){
+      const uint8_t *scanline = pixels + scanlineWidth * row;
+      for(int x = 0; x < width; x += 32){
+        int n = width - x < 32 ? width - x : 32;
+        expandDirect<PixelRGB888>(scanline, x, n, colors);
+        for(int i = 0; i < n; i++){
+          uint32_t *sum = sums + 4 * bins[((colors[i].r >> 4) << 8) | ((colors[i].g >> 4) << 4) | (colors[i].b >> 4)];
+          if(sum[3] >= 0x1000000)
+            continue;
+          sum[0] += colors[i].r;
+          sum[1] += colors[i].g;
+          sum[2] += colors[i].b;
+          sum[3]++;
+        }
+      }
+    }
+    for(int i = 0; i < count; i++){
+      uint32_t *sum = sums + 4 * i;
+      uint32_t total = sum[3] > 0 ? sum[3] : 1;
+      quantizePalette[i] = Format::fromRGBA(sum[0] / total, sum[1] / total, sum[2] / total, 0);
+    }
+    quantizeColors = count;
+    quantizeMap = bins;
+    delete[] sums;
+    BITMAP_STAT(statFreed(256 * 4 * sizeof(uint32_t)));
+}
+
+template<class Format>
+void ESPBitmapT<Format>::releaseQuantizeMap()
+{
+    if(quantizeMap != 0){
+      delete[] quantizeMap;
+      BITMAP_STAT(statFreed(4096 * sizeof(uint16_t)));
+    }
+    quantizeMap = 0;
+}
+
+template<class Format>
+void ESPBitmapT<Format>::endQuantize()
+{
+    if(quantizePalette == 0)
+      return;
+
+    //from here on it's an 8bpp image like any other.
+    palette = quantizePalette;
+    paletteColors = quantizeColors;
+    expandTable = 0;
+    colorData = pixelData;
+    colorDataBorrowed = false;
+    scanlineWidth = pixelRowBytes;
+    bitsPerPixel = 8;
+    data_length = scanlineWidth * height;
+    compression = BI_UNCOMPRESSED;
+    rgb565 = false;
+    pixelData = 0;
+    pixelRowBytes = 0;
+    quantizePalette = 0;
+    quantizeColors = 0;
+    releaseQuantizeMap();
+}
+
+template<class Format>
+BITMAP_RESULT_t ESPBitmapT<Format>::allocatePalette(size_t colors)
+{
+    size_t entries = paletteEntries(colors);
+    palette = (Pixel *)takeStorage(entries * sizeof(Pixel));
+    if(palette == 0)
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    paletteColors = colors;
+    for(size_t i = colors; i < entries; i++)
+      palette[i] = ERROR_COLOR;
+
+    //a dithered image is converted from the lumas instead (and gets no table).
+    size_t lumaSize = paletteLumaSize(bitsPerPixel);
+    if(lumaSize > 0){
+      paletteLuma = (uint8_t *)takeStorage(lumaSize);
+      if(paletteLuma == 0)
+        return BITMAP_ERROR_OUT_OF_MEMORY;
+      PIXEL_t error = Format::toRGBA(ERROR_COLOR);
+      memset(paletteLuma, PixelGray8::fromRGBA(error.r, error.g, error.b, 0), lumaSize);
+    }
+
+    //the table follows the palette when there's room for it, otherwise rows are expanded a pixel at a time.
+    //indexes past a short palette keep ERROR_COLOR here too.
+    size_t tableSize = expandTableSize(bitsPerPixel);
+    if(tableSize > 0)
+      expandTable = (Pixel *)takeStorage(tableSize * sizeof(Pixel));
+    if(expandTable != 0){
+      for(size_t i = 0; i < tableSize; i++)
+        expandTable[i] = ERROR_COLOR;
+    }
+    return BITMAP_SUCCESS;
+}
+
+template<class Format>
+size_t ESPBitmapT<Format>::expandTableSize(int bits)
+{
+    //box filtered images are BGR by the time they're read.
+    if(!expandTables || (scale != 0 && scaleFilter == BITMAP_SCALE_BOX) || paletteLumaSize(bits) > 0)
+      return 0;
+    if(bits == 1)
+      return 16 * 4;
+    if(bits == 2)
+      return 16 * 2;
+    if(bits == 4)
+      return 256 * 2;
+    return 0;
+}
+
+template<class Format>
+size_t ESPBitmapT<Format>::paletteLumaSize(int bits)
+{
+    if(!dithers() || bits > 8 || !convertsPixels())
+      return 0;
+    return 1 << bits;
+}
+
+template<class Format>
+size_t ESPBitmapT<Format>::storageNeeded(size_t colors, size_t pixelLength, bool borrowed)
+{
+    //converted images are kept in pixelData, anything else in colorData.
+    size_t paletteBytes = storageBytes(paletteEntries(colors) * sizeof(Pixel)) + storageBytes(colors > 0 ? expandTableSize(bitsPerPixel) * sizeof(Pixel) : 0)
+      + storageBytes(colors > 0 ? paletteLumaSize(bitsPerPixel) : 0);
+    if(convertsPixels()){
+      int32_t w = scale != 0 ? scale->width : width;
+      int32_t h = scale != 0 ? scale->height : height;
+      if(quantizes())
+        return paletteBytes + storageBytes(256 * sizeof(Pixel)) + storageBytes(4 * ((w + 3) / 4) * h);
+      return paletteBytes + storageBytes((w * Format::bits + 7) / 8 * h);
+    }
+    if(premultiplies())
+      return paletteBytes + colorDataStorage(pixelLength, false) + storageBytes((scale != 0 ? scale->height : height) * 2 * sizeof(uint16_t));
+    return paletteBytes + colorDataStorage(pixelLength, borrowed);
+}
+
+template<class Format>
+void ESPBitmapT<Format>::clearImage()
+{
+    palette = 0;
+    paletteColors = 0;
+    expandTable = 0;
+    paletteLuma = 0;
+    alphaSpans = 0;
+    alphaBytes = false;
+    quantizePalette = 0;
+    quantizeColors = 0;
+    releaseQuantizeMap();
+    pixelData = 0;
+    pixelRowBytes = 0;
+    if(loadScanline != 0){
+      delete[] loadScanline;
+      BITMAP_STAT(statFreed(scanlineWidth));
+    }
+    loadScanline = 0;
+    ESPBitmapBase::clearImage();
+}
+
+template<class Format>
+void ESPBitmapT<Format>::setPaletteColor(size_t index, const uint8_t *bgra)
+{
+    setPaletteEntry(index, Format::fromRGBA(bgra[2], bgra[1], bgra[0], bgra[3]));
+    if(paletteLuma != 0 && index < ((size_t)1 << bitsPerPixel))
+      paletteLuma[index] = PixelGray8::fromRGBA(bgra[2], bgra[1], bgra[0], 0);
+}
+
+template<class Format>
+void ESPBitmapT<Format>::setPaletteEntry(size_t index, Pixel color)
+{
+    palette[index] = color;
+    if(expandTable == 0)
+      return;
+
+    //every place the index shows up in the table.
+    if(bitsPerPixel < 4){
+      int bits = bitsPerPixel;
+      int perNibble = 4 / bits;
+      for(int nibble = 0; nibble < 16; nibble++)
+        for(int i = 0; i < perNibble; i++)
+          if(((nibble >> (4 - bits * (i + 1))) & ((1 << bits) - 1)) == (int)index)
+            expandTable[nibble * perNibble + i] = color;
+    }
+    else{
+      for(int other = 0; other < 16; other++){
+        expandTable[((index << 4) | other) * 2] = color;
+        expandTable[((other << 4) | index) * 2 + 1] = color;
+      }
+    }
+}
+
+template<class Format>
+BITMAP_RESULT_t ESPBitmapT<Format>::beginPixelData(size_t length)
+{
+    if(!convertsPixels() || scale != 0)
+      return ESPBitmapBase::beginPixelData(length);
+
+    //16, 24 and 32bpp images are converted into pixelData as each scanline arrives.
+    BITMAP_RESULT_t result = allocateConverted(width, height);
+    if(result != BITMAP_SUCCESS)
+      return result;
+    loadScanline = new uint8_t[scanlineWidth];
+    loadScanlineFill = 0;
+    if(loadScanline == 0)
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    BITMAP_STAT(statAllocated(scanlineWidth));
+    return BITMAP_SUCCESS;
+}
+
+template<class Format>
+void ESPBitmapT<Format>::storePixelData(const uint8_t *data, size_t offset, size_t count)
+{
+    if(pixelData == 0 || scale != 0){
+      ESPBitmapBase::storePixelData(data, offset, count);
+      return;
+    }
+
+    //whole scanlines are converted straight out of data, the pieces around them are gathered in loadScanline first.
+    while(count > 0){
+      size_t row = offset / scanlineWidth;
+      if(loadScanlineFill == 0 && count >= scanlineWidth){
+        convertRow(data, false, row, width, pixelData + pixelRowBytes * row);
+        data += scanlineWidth;
+        offset += scanlineWidth;
+        count -= scanlineWidth;
+        continue;
+      }
+      size_t n = scanlineWidth - loadScanlineFill;
+      if(n > count)
+        n = count;
+      memcpy(loadScanline + loadScanlineFill, data, n);
+      loadScanlineFill += n;
+      data += n;
+      offset += n;
+      count -= n;
+      if(loadScanlineFill == scanlineWidth){
+        convertRow(loadScanline, false, row, width, pixelData + pixelRowBytes * row);
+        loadScanlineFill = 0;
+      }
+    }
+}
+
+template<class Format>
+BITMAP_RESULT_t ESPBitmapT<Format>::endPixelData(size_t length)
+{
+    if(loadScanline != 0){
+      delete[] loadScanline;
+      BITMAP_STAT(statFreed(scanlineWidth));
+    }
+    loadScanline = 0;
+    BITMAP_RESULT_t result = ESPBitmapBase::endPixelData(length);
+    if(result == BITMAP_SUCCESS)
+      result = premultiplyImage();
+    if(result == BITMAP_SUCCESS){
+      endQuantize();
+      repackImage();
+    }
+    return result;
+}
+
+//the distinct colors of an image being repacked, up to 256 of them, found by hashing their bytes.
+template<class Pixel>
+struct RepackColors
+{
+  Pixel colors[256];
+  uint16_t slots[512];  //index + 1 of the color that hashed there, 0 for none
+  int count;
+
+  RepackColors() : count(0) { memset(slots, 0, sizeof(slots)); }
+
+  //index of color, added if it's new. -1 when there are already 256 others.
+  int find(const Pixel &color) {
+    uint32_t bytes = 0;
+    memcpy(&bytes, &color, sizeof(Pixel) < 4 ? sizeof(Pixel) : 4);
+    uint32_t slot = (bytes * 2654435761u) >> 23;
+    while(slots[slot] != 0){
+      if(memcmp(&colors[slots[slot] - 1], &color, sizeof(Pixel)) == 0)
+        return slots[slot] - 1;
+      slot = (slot + 1) & 511;
+    }
+    if(count == 256)
+      return -1;
+    colors[count] = color;
+    slots[slot] = ++count;
+    return count - 1;
+  }
+};
+
+template<class Format>
+void ESPBitmapT<Format>::repackImage()
+{
+    //images kept compressed, borrowed or left in a file are already as small as they're going to get here.
+    //dithered images are already packed into as few bits as their levels take, premultiplied ones need their alpha.
+    if(!repack || rleRows != 0 || colorDataBorrowed || (colorData == 0 && pixelData == 0) || width <= 0 || height <= 0 || dithers()
+       || alphaSpans != 0)
+      return;
+
+    RepackColors<Pixel> *found = new RepackColors<Pixel>();
+    Pixel *row = new Pixel[width];
+    if(found == 0 || row == 0){
+      delete found;
+      delete[] row;
+      return;
+    }
+    BITMAP_STAT(statAllocated(sizeof(RepackColors<Pixel>) + width * sizeof(Pixel)));
+
+    //first see if there are few enough colors, giving up at the 257th. runs of one color are only looked up once.
+    bool few = true;
+    for(int y = 0; y < height && few; y++){
+      copyRow(y, 0, width, row);
+      for(int x = 0; x < width; x++){
+        if(x > 0 && memcmp(&row[x], &row[x - 1], sizeof(Pixel)) == 0)
+          continue;
+        if(found->find(row[x]) < 0){
+          few = false;
+          break;
+        }
+      }
+    }
+
+    int bits = found->count <= 2 ? 1 : found->count <= 4 ? 2 : found->count <= 16 ? 4 : 8;
+    size_t packedWidth = 4 * ((width * bits + 31) / 32);
+    size_t paletteBytes = storageBytes(((size_t)1 << bits) * sizeof(Pixel)) + storageBytes(expandTableSize(bits) * sizeof(Pixel));
+    size_t bytes = paletteBytes + storageBytes(packedWidth * height);
+    uint8_t *block = (few && bytes < storageUsed) ? allocateStorage(bytes) : 0;
+    if(block != 0){
+      //the rows go after the palette and its table, which are set up once the old image is gone.
+      uint8_t *packed = block + paletteBytes;
+      memset(packed, 0, packedWidth * height);
+      for(int y = 0; y < height; y++){
+        copyRow(y, 0, width, row);
+        uint8_t *dst = packed + packedWidth * storedRow(y);
+        int index = 0;
+        for(int x = 0; x < width; x++){
+          if(x == 0 || memcmp(&row[x], &row[x - 1], sizeof(Pixel)) != 0)
+            index = found->find(row[x]);
+          int bit = x * bits;
+          dst[bit >> 3] |= index << (8 - bits - (bit & 7));
+        }
+      }
+
+      replaceStorage(block, bytes);
+      palette = 0;
+      expandTable = 0;
+      pixelData = 0;
+      pixelRowBytes = 0;
+      bitsPerPixel = bits;
+      scanlineWidth = packedWidth;
+      data_length = packedWidth * height;
+      compression = BI_UNCOMPRESSED;
+      rgb565 = false;
+      allocatePalette(found->count);
+      for(int i = 0; i < found->count; i++)
+        setPaletteEntry(i, found->colors[i]);
+      colorData = (uint8_t *)takeStorage(data_length);
+    }
+
+    delete found;
+    delete[] row;
+    BITMAP_STAT(statFreed(sizeof(RepackColors<Pixel>) + width * sizeof(Pixel)));
+}
+
+template<class Format>
+bool ESPBitmapT<Format>::premultiplies()
+{
+    //images without alpha convert like any other.
+    if(!premultiply || bitsPerPixel != 32 || width > 0xFFFF)
+      return false;
+    if(scale != 0 && scaleFilter == BITMAP_SCALE_BOX)
+      return false;
+    return channels[3].mask != 0 || (alphaBytes && compression == BI_UNCOMPRESSED);
+}
+
+template<class Format>
+bool ESPBitmapT<Format>::findAlphaBytes(const uint8_t *data, int32_t length)
+{
+    //plenty of tools write BI_RGB 32bpp with the 4th byte left 0 (or 255), those are opaque.
+    if(width <= 0 || height <= 0 || length < 0 || (size_t)length < scanlineWidth * height)
+      return false;
+    bool zero = false, other = false;
+    for(int32_t row = 0; row < height; row++){
+      const uint8_t *src = data + scanlineWidth * row;
+      for(int32_t x = 0; x < width; x++){
+        uint8_t a = src[4 * x + 3];
+        if(a != 0 && a != 255)
+          return true;
+        if(a == 0)
+          zero = true;
+        else
+          other = true;
+        if(zero && other)
+          return true;
+      }
+    }
+    return false;
+}
+
+//c * a / 255 rounded, without a divide.
+static inline uint8_t mulDiv255(uint32_t c, uint32_t a)
+{
+    uint32_t v = c * a + 128;
+    return (v + (v >> 8)) >> 8;
+}
+
+template<class Format>
+BITMAP_RESULT_t ESPBitmapT<Format>::premultiplyImage()
+{
+    if(!premultiplies() || colorData == 0 || colorDataBorrowed || rleRows != 0)
+      return BITMAP_SUCCESS;
+    alphaSpans = (uint16_t *)takeStorage(height * 2 * sizeof(uint16_t));
+    if(alphaSpans == 0)
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+
+    //a BI_RGB image's alpha is its 4th byte.
+    if(channels[3].mask == 0)
+      setChannelMasks(channels[0].mask, channels[1].mask, channels[2].mask, 0xFF000000);
+
+    //rewritten in place as BGRA, whatever the masks were.
+    const BITMAP_CHANNEL_t red = channels[0], green = channels[1], blue = channels[2], alpha = channels[3];
+    for(int32_t row = 0; row < height; row++){
+      uint8_t *p = colorData + scanlineWidth * row;
+      int32_t first = -1, end = 0;
+      for(int32_t x = 0; x < width; x++, p += 4){
+        uint32_t pixel = p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        uint8_t a = channelValue(pixel, alpha);
+        p[0] = mulDiv255(channelValue(pixel, blue), a);
+        p[1] = mulDiv255(channelValue(pixel, green), a);
+        p[2] = mulDiv255(channelValue(pixel, red), a);
+        p[3] = a;
+        if(a != 0){
+          if(first < 0)
+            first = x;
+          end = x + 1;
+        }
+      }
+      alphaSpans[2 * row] = first < 0 ? 0 : first;
+      alphaSpans[2 * row + 1] = end;
+    }
+    setChannelMasks(0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    return BITMAP_SUCCESS;
+}
+
+template<class Format>
+int ESPBitmapT<Format>::blendRow(const uint8_t *row, int first, int end, Pixel *dst)
+{
+    //runs of one kind at a time: opaque ones are a straight conversion, transparent ones are skipped,
+    //anything between is dst * (255 - a) / 255 plus the premultiplied color.
+    int shown = 0;
+    int x = first;
+    while(x < end){
+      uint8_t a = row[4 * x + 3];
+      int run = x + 1;
+      while(run < end && row[4 * run + 3] == a && (a == 0 || a == 255))
+        run++;
+      if(a == 255)
+        Format::fromBGRA32(row + 4 * x, run - x, dst + x, true);
+      else if(a != 0){
+        const uint8_t *src = row + 4 * x;
+        PIXEL_t under = Format::toRGBA(dst[x]);
+        uint8_t keep = 255 - a;
+        dst[x] = Format::fromRGBA(src[2] + mulDiv255(under.r, keep), src[1] + mulDiv255(under.g, keep),
+                                  src[0] + mulDiv255(under.b, keep), a + mulDiv255(under.a, keep));
+      }
+      if(a != 0)
+        shown += run - x;
+      x = run;
+    }
+    return shown;
+}
+
+template<class Format>
+int ESPBitmapT<Format>::blendOnto(Pixel *dst, int dstStride, int x, int y, int dstWidth, int dstHeight)
+{
+    //the part of the image that lands on dst.
+    int left = x < 0 ? -x : 0;
+    int top = y < 0 ? -y : 0;
+    int right = width < dstWidth - x ? width : dstWidth - x;
+    int bottom = height < dstHeight - y ? height : dstHeight - y;
+    if(left >= right || top >= bottom)
+      return 0;
+
+    dst += (y + top) * dstStride + x;
+    if(alphaSpans == 0)
+      return copyRect(left, top, right - left, bottom - top, dst + left, dstStride);
+
+    int shown = 0;
+    for(int row = top; row < bottom; row++, dst += dstStride){
+      int stored = storedRow(row);
+      int first = alphaSpans[2 * stored] > left ? alphaSpans[2 * stored] : left;
+      int end = alphaSpans[2 * stored + 1] < right ? alphaSpans[2 * stored + 1] : right;
+      if(first < end)
+        shown += blendRow(colorData + scanlineWidth * stored, first, end, dst);
+    }
+    return shown;
+}
+
+#ifdef ESP8266
+
+template<class Format>
+BITMAP_RESULT_t ESPBitmapT<Format>::StreamDecode(Stream* stream, int len, int timeoutMs, void (*scanLineCallBack)(int y, Pixel *pixels, int width)){
+
+  unsigned long startMs = millis();
+  //the headers below replace the loaded image, so it's cleared first.
+  reset();
+  BITMAP_STAT(resetStats());
+
+  BITMAP_FILE_HEADER_t bitmapHeader;
+  BITMAP_INFO_HEADER_t bitmapInfo;
+  if(!readStreamBytes(stream, (uint8_t *)&bitmapHeader, sizeof(BITMAP_FILE_HEADER_t), startMs, timeoutMs)
+     || !readStreamBytes(stream, (uint8_t *)&bitmapInfo, sizeof(BITMAP_INFO_HEADER_t), startMs, timeoutMs))
+    return BITMAP_ERROR_FETCH_FAILED;
+
+  size_t colorsToLoad = 0;
+  BITMAP_RESULT_t result = parseHeaders(bitmapHeader, bitmapInfo, colorsToLoad);
+  if(result != BITMAP_SUCCESS)
+    return result;
+  BITMAP_STAT(statPhase(stats.headerMicros));
+
+  size_t readOffset = sizeof(BITMAP_FILE_HEADER_t) + sizeof(BITMAP_INFO_HEADER_t);
+  size_t paletteOffset = sizeof(BITMAP_FILE_HEADER_t) + bitmapInfo.headerSize;
+
+  //bitfield masks come straight after the part of the info header we have already read.
+  size_t maskLength = maskBytes(bitmapInfo);
+  if(maskLength > 0){
+    if(BITMAP_MASKS_OFFSET + maskLength > (size_t)dataOffset)
+      return BITMAP_ERROR_TOO_SHORT;
+    uint8_t masks[16];
+    if(!readStreamBytes(stream, masks, maskLength, startMs, timeoutMs))
+      return BITMAP_ERROR_FETCH_FAILED;
+    loadChannelMasks(masks, maskLength);
+    readOffset += maskLength;
+  }
+  //RLE rows come out of a small chunk of compressed data at a time.
+  StreamRLEState rleState;
+  rleState.rle.begin(bitsPerPixel, width);
+  size_t pixelDataLength = 0;
+  result = findPixelLength(bitmapHeader, bitmapInfo, len > 0 ? len : -1, pixelDataLength);
+  if(result != BITMAP_SUCCESS)
+    return result;
+  rleState.remaining = isRLE() ? pixelDataLength : 0;
+
+  //a palette entry can't start after the pixel data, and we need every row to be there.
+  if(paletteOffset + colorsToLoad * 4 > (size_t)dataOffset
+     || (len > 0 && dataOffset + pixelDataLength > (size_t)len))
+    return BITMAP_ERROR_TOO_SHORT;
+
+  //this palette is only used for this decode, the object doesn't hold on to it. padded like allocatePalette's.
+  Pixel *streamPalette = 0;
+  size_t paletteSize = paletteEntries(colorsToLoad);
+  if(colorsToLoad > 0){
+    streamPalette = new Pixel[paletteSize];
+    if(streamPalette == 0)
+      return BITMAP_ERROR_OUT_OF_MEMORY;
+    for(size_t i = colorsToLoad; i < paletteSize; i++)
+      streamPalette[i] = ERROR_COLOR;
+  }
+  uint8_t *scanline = new uint8_t[scanlineWidth];
+  Pixel *pixels = new Pixel[width];
+  BITMAP_STAT(statAllocated(paletteSize * sizeof(Pixel) + scanlineWidth + width * sizeof(Pixel)));
+
+  if(scanline == 0 || pixels == 0)
+    result = BITMAP_ERROR_OUT_OF_MEMORY;
+  //throw away anything in a > 40 byte info header.
+  else if(readOffset < paletteOffset && !skipStreamBytes(stream, paletteOffset - readOffset, startMs, timeoutMs))
+    result = BITMAP_ERROR_FETCH_FAILED;
+  else {
+    if(readOffset < paletteOffset)
+      readOffset = paletteOffset;
+    for(size_t i = 0; i < colorsToLoad && result == BITMAP_SUCCESS; i++){
+      uint8_t bgra[4];
+      if(!readStreamBytes(stream, bgra, 4, startMs, timeoutMs)){
+        result = BITMAP_ERROR_FETCH_FAILED;
+        break;
+      }
+      streamPalette[i] = Format::fromRGBA(bgra[2], bgra[1], bgra[0], bgra[3]);
+      readOffset += 4;
+    }
+
+    //skip any gap between the palette and the pixel data.
+    if(result == BITMAP_SUCCESS && !skipStreamBytes(stream, dataOffset - readOffset, startMs, timeoutMs))
+      result = BITMAP_ERROR_FETCH_FAILED;
+    BITMAP_STAT(statPhase(stats.paletteMicros));
+
+    for(int row = 0; row < height && result == BITMAP_SUCCESS; row++){
+      bool gotRow = !isRLE()
+        ? readStreamBytes(stream, scanline, scanlineWidth, startMs, timeoutMs)
+        : readStreamRLERow(stream, rleState, scanline, startMs, timeoutMs);
+      if(!gotRow){
+        result = BITMAP_ERROR_FETCH_FAILED;
+        break;
+      }
+      expandScanline(scanline, streamPalette, 0, width, pixels);
+      scanLineCallBack(flipped ? row : (height - 1) - row, pixels, width);
+    }
+  }
+
+  BITMAP_STAT(statPhase(stats.dataMicros));
+  BITMAP_STAT(statFreed(paletteSize * sizeof(Pixel) + scanlineWidth + width * sizeof(Pixel)));
+  if(streamPalette != 0)
+    delete[] streamPalette;
+  if(scanline != 0)
+    delete[] scanline;
+  if(pixels != 0)
+    delete[] pixels;
+  return result;
+}
+#endif
+
+template<class Format>
+void ESPBitmapT<Format>::expandScanline(const uint8_t *scanline, const Pixel *pal, int x0, int count, Pixel *dst){
+  int x = x0;
+  int end = x0 + count;
+  switch (bitsPerPixel) {
+    case 1:
+      {
+        //line up with a byte boundary, then take 8 pixels out of each byte.
+        for(; x < end && (x & 7); x++)
+          *dst++ = pal[(scanline[x >> 3] >> (7 - (x & 7))) & 0x01];
+        const uint8_t *src = scanline + (x >> 3);
+        //with the image's own palette a byte is two copies out of the table.
+        if(expandTable != 0 && pal == palette){
+          for(; x + 8 <= end; x += 8, dst += 8){
+            uint8_t bits = *src++;
+            memcpy(dst, expandTable + (bits >> 4) * 4, 4 * sizeof(Pixel));
+            memcpy(dst + 4, expandTable + (bits & 0x0F) * 4, 4 * sizeof(Pixel));
+          }
+        }
+        for(; x + 8 <= end; x += 8, dst += 8){
+          uint8_t bits = *src++;
+          dst[0] = pal[bits >> 7];
+          dst[1] = pal[(bits >> 6) & 0x01];
+          dst[2] = pal[(bits >> 5) & 0x01];
+          dst[3] = pal[(bits >> 4) & 0x01];
+          dst[4] = pal[(bits >> 3) & 0x01];
+          dst[5] = pal[(bits >> 2) & 0x01];
+          dst[6] = pal[(bits >> 1) & 0x01];
+          dst[7] = pal[bits & 0x01];
+        }
+        for(; x < end; x++)
+          *dst++ = pal[(scanline[x >> 3] >> (7 - (x & 7))) & 0x01];
+      }
+      break;
+    case 2:
+      {
+        //only repacked images are 2bpp, they get a table of 2 pixels for each nibble.
+        if(expandTable != 0 && pal == palette){
+          for(; x < end && (x & 3); x++)
+            *dst++ = pal[(scanline[x >> 2] >> (6 - 2 * (x & 3))) & 0x03];
+          const uint8_t *src = scanline + (x >> 2);
+          for(; x + 4 <= end; x += 4, dst += 4){
+            uint8_t bits = *src++;
+            memcpy(dst, expandTable + (bits >> 4) * 2, 2 * sizeof(Pixel));
+            memcpy(dst + 2, expandTable + (bits & 0x0F) * 2, 2 * sizeof(Pixel));
+          }
+        }
+        for(; x < end; x++)
+          *dst++ = pal[(scanline[x >> 2] >> (6 - 2 * (x & 3))) & 0x03];
+      }
+      break;
+    case 4:
+      {
+        //an odd start is the low nibble, after that each byte is two pixels.
+        if(x < end && (x & 1)){
+          *dst++ = pal[scanline[x >> 1] & 0x0F];
+          x++;
+        }
+        const uint8_t *src = scanline + (x >> 1);
+        if(expandTable != 0 && pal == palette){
+          for(; x + 2 <= end; x += 2, dst += 2)
+            memcpy(dst, expandTable + *src++ * 2, 2 * sizeof(Pixel));
+        }
+        for(; x + 2 <= end; x += 2, dst += 2){
+          uint8_t pair = *src++;
+          dst[0] = pal[pair >> 4];
+          dst[1] = pal[pair & 0x0F];
+        }
+        if(x < end)
+          *dst = pal[*src >> 4];
+      }
+      break;
+    case 8:
+      {
+        const uint8_t *src = scanline + x;
+        for(; x < end; x++)
+          *dst++ = pal[*src++];
+      }
+      break;
+    default:
+      expandDirect<Format>(scanline, x0, count, dst);
+      break;
+  }
+}
+
+template<class Format>
+template<class To>
+void ESPBitmapT<Format>::expandDirect(const uint8_t *scanline, int x0, int count, typename To::Pixel *dst){
+  int x = x0;
+  int end = x0 + count;
+  switch (bitsPerPixel) {
+    case 24:
+      To::fromBGR24(scanline + x * 3, count, dst);
+      break;
+    case 16:
+      {
+        const uint8_t *src = scanline + x * 2;
+        if(rgb565){
+          To::fromRGB565(src, count, dst);
+          break;
+        }
+        const BITMAP_CHANNEL_t red = channels[0], green = channels[1], blue = channels[2], alpha = channels[3];
+        for(; x < end; x++, src += 2){
+          uint32_t pixel = src[0] | (src[1] << 8);
+          *dst++ = To::fromRGBA(channelValue(pixel, red), channelValue(pixel, green), channelValue(pixel, blue), channelValue(pixel, alpha));
+        }
+      }
+      break;
+    case 32:
+      {
+        const uint8_t *src = scanline + x * 4;
+        //plain BGRA/BGRX byte order needs no masks.
+        if(channels[0].mask == 0x00FF0000 && channels[1].mask == 0x0000FF00 && channels[2].mask == 0x000000FF
+           && (channels[3].mask == 0 || channels[3].mask == 0xFF000000)){
+          To::fromBGRA32(src, count, dst, channels[3].mask != 0);
+          break;
+        }
+        const BITMAP_CHANNEL_t red = channels[0], green = channels[1], blue = channels[2], alpha = channels[3];
+        for(; x < end; x++, src += 4){
+          uint32_t pixel = src[0] | (src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+          *dst++ = To::fromRGBA(channelValue(pixel, red), channelValue(pixel, green), channelValue(pixel, blue), channelValue(pixel, alpha));
+        }
+      }
+      break;
+  }
+}
+
+template<class Format>
+BITMAP_RESULT_t ESPBitmapT<Format>::allocateScaled()
+{
+    if(!convertsPixels())
+      return ESPBitmapBase::allocateScaled();
+
+    return allocateConverted(scale->width, scale->height);
+}
+
+template<class Format>
+void ESPBitmapT<Format>::storeScaledRow(const uint8_t *row, int32_t index)
+{
+    if(pixelData == 0){
+      ESPBitmapBase::storeScaledRow(row, index);
+      return;
+    }
+
+    //box filtered rows are BGR, picked ones are still in the image's own format.
+    convertRow(row, scaleFilter == BITMAP_SCALE_BOX, index, scale->width, pixelData + pixelRowBytes * index);
+}
+
+template<class Format>
+void ESPBitmapT<Format>::sourceRowColors(const uint8_t *scanline, int x0, int count, PIXEL_t *dst)
+{
+    //quantized images are averaged from the file's own colors, not Format's.
+    if((quantizePalette != 0 || dithers()) && bitsPerPixel >= 16){
+      expandDirect<PixelRGB888>(scanline, x0, count, dst);
+      return;
+    }
+    //dithered ones from the palette's lumas, the palette itself is already cut down to Format's levels.
+    if(paletteLuma != 0){
+      int bits = bitsPerPixel;
+      for(int x = 0; x < count; x++){
+        int bit = (x0 + x) * bits;
+        uint8_t v = paletteLuma[(scanline[bit >> 3] >> (8 - bits - (bit & 7))) & ((1 << bits) - 1)];
+        dst[x].r = dst[x].g = dst[x].b = v;
+        dst[x].a = 0;
+      }
+      return;
+    }
+    //the pixels go at the end of dst, each one is read before the color written over it
+    //(colors are at least as big as pixels, so the writes never catch up with the reads).
+    Pixel *packed = (Pixel *)((uint8_t *)(dst + count) - count * sizeof(Pixel));
+    expandScanline(scanline, palette, x0, count, packed);
+    for(int x = 0; x < count; x++){
+      Pixel p = packed[x];
+      dst[x] = Format::toRGBA(p);
+    }
+}
+
+template<class Format>
+typename ESPBitmapT<Format>::Pixel ESPBitmapT<Format>::getPixel(int x, int y){
+
+    #ifndef FAST_AND_LOOSE
+    //bounds checking, this is a lot of unneccesary overhead,
+    //but in intrest of foolproofing, it's nice to have.
+    if(x < 0)
+      x = 0;
+    else if(x > width - 1)
+      x = width -1;
+
+    if(y < 0)
+      y = 0;
+    else if(y > height - 1)
+      y = height -1;
+    #endif
+
+    //assume y goes top to bottom like in all other graphics, handle flipped.
+    //not if (flipped) image is stored top to bottom, otherwise it is bottom to top.
+    if(!flipped)
+      y = (height-1) - y;
+
+
+    //general reference (I tend to forget these rules)
+    //Storing 2D in 1D array, using mappings:
+    //i = x + width*y;
+    //and
+    //x = i % width;    // % is the "modulo operator", the remainder of i / width;
+    //y = i / width;    // where "/" is an integer division
+
+    //converted images have been turned into Format already, with no scanline padding.
+    if(pixelData != 0){
+      Pixel pix;
+      readConverted(pixelData + pixelRowBytes * y, x, 1, &pix);
+      return pix;
+    }
+
+    //scanlineWidth (the 4 byte padded row size) is worked out once when the headers are parsed.
+    //RLE images that are kept compressed decode the row first, file backed ones read it in.
+    //if there's no row, then this is an empty image object.
+    const uint8_t *scanline = rowAt(y);
+    if(scanline == 0) return ERROR_COLOR;
+
+    switch (bitsPerPixel) {
+      case 1:
+        return palette[(scanline[x>>3]) >> (7 - (x % 8)) & 0x01];
+        break;
+      case 2:
+        return palette[(scanline[x>>2] >> (6 - 2 * (x & 3))) & 0x03];
+        break;
+      case 4:
+        return palette[((scanline[x>>1]) >> ((x%2==0)? 4:0)) & 0x0F];
+        break;
+      case 8:
+        return palette[(scanline[x])];
+        break;
+      case 24:
+        {
+          int offset = x * 3;
+          return Format::fromRGBA(scanline[offset + 2], scanline[offset + 1], scanline[offset], 0);
+        }
+        break;
+      case 16:
+      case 32:
+        {
+          //the channel masks are only dealt with in one place.
+          Pixel pix;
+          expandScanline(scanline, palette, x, 1, &pix);
+          return pix;
+        }
+        break;
+      default:
+        return ERROR_COLOR; break;
+    }
+}
+
+template<class Format>
+int ESPBitmapT<Format>::copyRow(int y, int x0, int count, Pixel *dst){
+  if(y < 0 || y >= height)
+    return 0;
+
+  //clip once for the whole span instead of per pixel.
+  if(x0 < 0){
+    dst -= x0;
+    count += x0;
+    x0 = 0;
+  }
+  if(count > width - x0)
+    count = width - x0;
+  if(count <= 0)
+    return 0;
+
+  //converted images are a straight copy.
+  if(pixelData != 0){
+    readConverted(pixelData + pixelRowBytes * storedRow(y), x0, count, dst);
+    return count;
+  }
+  const uint8_t *scanline = scanlineAt(y);
+  if(scanline == 0)
+    return 0;
+  expandScanline(scanline, palette, x0, count, dst);
+  return count;
+}
+
+template<class Format>
+int ESPBitmapT<Format>::copyRect(int x, int y, int w, int h, Pixel *dst, int dstStride){
+  //clip the rectangle once, then every row is a straight run.
+  if(y < 0){
+    dst -= y * dstStride;
+    h += y;
+    y = 0;
+  }
+  if(h > height - y)
+    h = height - y;
+  if(x < 0){
+    dst -= x;
+    w += x;
+    x = 0;
+  }
+  if(w > width - x)
+    w = width - x;
+  if(w <= 0 || h <= 0)
+    return 0;
+
+  for(int row = 0; row < h; row++, dst += dstStride){
+    if(pixelData != 0){
+      readConverted(pixelData + pixelRowBytes * storedRow(y + row), x, w, dst);
+      continue;
+    }
+    const uint8_t *scanline = scanlineAt(y + row);
+    if(scanline == 0)
+      return w * row;
+    expandScanline(scanline, palette, x, w, dst);
+  }
+  return w * h;
+}
+
+template<class Format>
+int ESPBitmapT<Format>::copySpan(int x, int y, int w, int h, uint32_t pos, Pixel *buffer, int count){
+  if(w <= 0 || h <= 0)
+    return 0;
+
+  //a piece of one row at a time, converted images are straight copies so a burst is a few memcpys.
+  uint32_t end = (uint32_t)w * h;
+  int written = 0;
+  while(written < count && pos < end){
+    int row = pos / w;
+    int column = pos - (uint32_t)row * w;
+    int n = w - column;
+    if(n > count - written)
+      n = count - written;
+    copyRow(y + row, x + column, n, buffer + written);
+    written += n;
+    pos += n;
+  }
+  return written;
+}
+
+//the formats the library is built with. a new one is a Format struct in ESPBitmapT.h and a line here.
+template class ESPBitmapT<PixelRGB888>;
+template class ESPBitmapT<PixelRGB565>;
+template class ESPBitmapT<PixelRGB565Swapped>;
+template class ESPBitmapT<PixelGray8>;
+template class ESPBitmapT<PixelGray4>;
+template class ESPBitmapT<PixelGray2>;
+template class ESPBitmapT<PixelMono1>;
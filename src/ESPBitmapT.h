@@ -0,0 +1,341 @@
+/*
+ESPBitmap Library
+Copyright 2018 Rickey Ward
+
+MIT License
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom
+the Software is furnished to do so, subject to the following conditions: The
+above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED "AS
+IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ESPBITMAPT_H_
+#define _ESPBITMAPT_H_
+
+#include <inttypes.h>
+#include "ESPBitmapBase.h"
+
+//what an ESPBitmapT hands out, picked at compile time so each one gets its own decode and access code.
+//a format has a Pixel type, converts colors to it (fromRGBA) and back (toRGBA), and says how many bits
+//a pixel takes and whether 16, 24 and 32bpp images are converted to it as they load (convertDirect).
+//converting costs time up front but makes reading a row a straight copy, and is smaller than 24bpp.
+//paletted images always keep their indexes, with the palette in the output format.
+//the whole-row conversions have plain versions here, formats replace them with faster ones where it pays.
+template<class Format, typename PixelT>
+struct ESPBitmapPixelFormat
+{
+  typedef PixelT Pixel;
+  static void fromBGR24(const uint8_t *src, int count, Pixel *dst) {
+    for(; count > 0; count--, src += 3)
+      *dst++ = Format::fromRGBA(src[2], src[1], src[0], 0);
+  }
+  static void fromBGRA32(const uint8_t *src, int count, Pixel *dst, bool hasAlpha) {
+    for(; count > 0; count--, src += 4)
+      *dst++ = Format::fromRGBA(src[2], src[1], src[0], hasAlpha ? src[3] : 0);
+  }
+  //16bpp pixels that are exactly RGB565, little endian like the file.
+  static void fromRGB565(const uint8_t *src, int count, Pixel *dst) {
+    for(; count > 0; count--, src += 2){
+      uint16_t c = src[0] | (src[1] << 8);
+      *dst++ = Format::fromRGBA(((c >> 8) & 0xF8) | (c >> 13), ((c >> 3) & 0xFC) | ((c >> 9) & 0x03), ((c << 3) & 0xF8) | ((c >> 2) & 0x07), 0);
+    }
+  }
+};
+
+//8 bits a channel and the alpha from the file, the pixel data is kept as it is in the file.
+struct PixelRGB888 : ESPBitmapPixelFormat<PixelRGB888, PIXEL_t>
+{
+  static const int bits = 32;
+  static const bool convertDirect = false;
+  static inline Pixel fromRGBA(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    Pixel p;
+    p.a = a;
+    p.r = r;
+    p.g = g;
+    p.b = b;
+    return p;
+  }
+  static inline PIXEL_t toRGBA(Pixel p) { return p; }
+};
+
+//RGB565 in the cpu's byte order (565 is standard for adafruit's amazing graphics library).
+struct PixelRGB565 : ESPBitmapPixelFormat<PixelRGB565, uint16_t>
+{
+  static const int bits = 16;
+  static const bool convertDirect = true;
+  static inline Pixel fromRGBA(uint8_t r, uint8_t g, uint8_t b, uint8_t /*a*/) { return ESPBitmapBase::Color(r, g, b); }
+  static inline PIXEL_t toRGBA(Pixel c) {
+    PIXEL_t p;
+    p.a = 0;
+    p.r = ((c >> 8) & 0xF8) | (c >> 13);
+    p.g = ((c >> 3) & 0xFC) | ((c >> 9) & 0x03);
+    p.b = ((c << 3) & 0xF8) | ((c >> 2) & 0x07);
+    return p;
+  }
+  static void fromBGR24(const uint8_t *src, int count, Pixel *dst);
+  static void fromBGRA32(const uint8_t *src, int count, Pixel *dst, bool hasAlpha);
+  static void fromRGB565(const uint8_t *src, int count, Pixel *dst);
+};
+
+//RGB565 with the bytes the other way around from PixelRGB565 on the ESP, big endian, the order
+//ILI9341 and ST7789 style panels want their pixels sent in.
+struct PixelRGB565Swapped : ESPBitmapPixelFormat<PixelRGB565Swapped, uint16_t>
+{
+  static const int bits = 16;
+  static const bool convertDirect = true;
+  static inline uint16_t swap(uint16_t c) { return (c >> 8) | (c << 8); }
+  static inline Pixel fromRGBA(uint8_t r, uint8_t g, uint8_t b, uint8_t /*a*/) { return swap(ESPBitmapBase::Color(r, g, b)); }
+  static inline PIXEL_t toRGBA(Pixel c) { return PixelRGB565::toRGBA(swap(c)); }
+  static void fromBGR24(const uint8_t *src, int count, Pixel *dst);
+  static void fromBGRA32(const uint8_t *src, int count, Pixel *dst, bool hasAlpha);
+  static void fromRGB565(const uint8_t *src, int count, Pixel *dst);
+};
+
+//8 bit luma (BT.601 weights), for grayscale panels and e-paper.
+struct PixelGray8 : ESPBitmapPixelFormat<PixelGray8, uint8_t>
+{
+  static const int bits = 8;
+  static const bool convertDirect = true;
+  static inline Pixel fromRGBA(uint8_t r, uint8_t g, uint8_t b, uint8_t /*a*/) { return (r * 77 + g * 150 + b * 29) >> 8; }
+  static inline PIXEL_t toRGBA(Pixel v) {
+    PIXEL_t p;
+    p.a = 0;
+    p.r = p.g = p.b = v;
+    return p;
+  }
+};
+
+//16 levels of gray (0 is black), converted images are packed 2 pixels to a byte, for 4 bit grayscale e-paper.
+//for this and the other packed formats paletted images of more bits than theirs are converted too, RLE ones
+//only when they're reduced.
+struct PixelGray4 : ESPBitmapPixelFormat<PixelGray4, uint8_t>
+{
+  static const int bits = 4;
+  static const bool convertDirect = true;
+  static inline Pixel fromRGBA(uint8_t r, uint8_t g, uint8_t b, uint8_t a) { return PixelGray8::fromRGBA(r, g, b, a) >> 4; }
+  static inline PIXEL_t toRGBA(Pixel v) { return PixelGray8::toRGBA(v * 17); }
+};
+
+//4 levels of gray (0 is black), converted images are packed 4 pixels to a byte, for 2 bit e-paper.
+struct PixelGray2 : ESPBitmapPixelFormat<PixelGray2, uint8_t>
+{
+  static const int bits = 2;
+  static const bool convertDirect = true;
+  static inline Pixel fromRGBA(uint8_t r, uint8_t g, uint8_t b, uint8_t a) { return PixelGray8::fromRGBA(r, g, b, a) >> 6; }
+  static inline PIXEL_t toRGBA(Pixel v) { return PixelGray8::toRGBA(v * 85); }
+};
+
+//1 for light and 0 for dark, converted images are packed 8 pixels to a byte.
+struct PixelMono1 : ESPBitmapPixelFormat<PixelMono1, uint8_t>
+{
+  static const int bits = 1;
+  static const bool convertDirect = true;
+  static inline Pixel fromRGBA(uint8_t r, uint8_t g, uint8_t b, uint8_t a) { return PixelGray8::fromRGBA(r, g, b, a) >> 7; }
+  static inline PIXEL_t toRGBA(Pixel v) { return PixelGray8::toRGBA(v ? 255 : 0); }
+};
+
+//how setQuantize reduces 16, 24 and 32bpp images to 8bpp indexes.
+typedef enum
+{
+  BITMAP_QUANTIZE_OFF = 0,    //kept in the format's own pixels
+  BITMAP_QUANTIZE_332,        //a fixed palette of 8 reds, 8 greens and 4 blues, one pass, the same for every image
+  BITMAP_QUANTIZE_MEDIAN_CUT  //a palette made for the image by DecodeFileBuffer, streams use 332
+} BITMAP_QUANTIZE_t;
+
+template<class Format>
+class ESPBitmapT : public ESPBitmapBase
+{
+  public:
+    typedef typename Format::Pixel Pixel;
+
+  protected:
+    Pixel * palette = 0;
+    size_t paletteColors = 0;
+    //entries the palette of a paletted image gets, one for every index its bits can hold, so indexes past a short
+    //palette find ERROR_COLOR instead of whatever follows it.
+    size_t paletteEntries(size_t colors) { return colors > 0 && bitsPerPixel <= 8 ? (size_t)1 << bitsPerPixel : colors; }
+    //1, 2 and 4bpp rows expand a byte at a time through this, kept up to date as palette entries are set:
+    //the 4 (1bpp) or 2 (2bpp) pixels of each nibble, or the 2 pixels of each 4bpp byte. 0 when there isn't one.
+    Pixel * expandTable = 0;
+    bool expandTables = true;
+    //pixels in the table for an image of bits per pixel, 0 when it doesn't get one.
+    size_t expandTableSize(int bits);
+    //sets a palette entry and the places it shows up in expandTable.
+    void setPaletteEntry(size_t index, Pixel color);
+    //setRepack, rewrites a loaded image of few colors as 1, 2, 4 or 8bpp indexes into a smaller block.
+    bool repack = false;
+    void repackImage();
+    //16, 24 and 32bpp (and box filtered) images converted to Format when loaded, rows of pixelRowBytes.
+    uint8_t * pixelData = 0;
+    size_t pixelRowBytes = 0;
+
+    //converts count pixels starting at x0 of one raw scanline (as stored in the file) using the given palette.
+    //all the per bitdepth decisions are made once here instead of per pixel.
+    void expandScanline(const uint8_t *scanline, const Pixel *pal, int x0, int count, Pixel *dst);
+    //whether this image ends up in pixelData, and converting a raw (or box reduced BGR) row into it.
+    bool convertsPixels();
+    //y is the stored row, which the dither pattern follows.
+    void convertRow(const uint8_t *raw, bool bgr, int32_t y, int count, uint8_t *dst);
+    //takes pixelData (and a quantized image's palette) for w x h converted pixels.
+    BITMAP_RESULT_t allocateConverted(int32_t w, int32_t h);
+    //count pixels of a 16, 24 or 32bpp raw scanline starting at x0, as the pixels of format To.
+    template<class To>
+    void expandDirect(const uint8_t *scanline, int x0, int count, typename To::Pixel *dst);
+
+    //setQuantize. while a 16, 24 or 32bpp (or box filtered) image loads its 8bpp indexes go in pixelData,
+    //and quantizePalette takes over as the palette once it's all in.
+    BITMAP_QUANTIZE_t quantize = BITMAP_QUANTIZE_OFF;
+    Pixel * quantizePalette = 0;
+    size_t quantizeColors = 0;
+    //median cut: the palette index of each 4 bits a channel color, 0 for 332.
+    uint16_t * quantizeMap = 0;
+    bool quantizes();
+    void quantizeRow(const uint8_t *raw, bool bgr, int count, uint8_t *dst);
+    //builds a median cut palette and quantizeMap from the pixel data of a whole file buffer.
+    void medianCut(const uint8_t *pixels);
+    //turns the loaded indexes into an ordinary 8bpp image.
+    void endQuantize();
+    void releaseQuantizeMap();
+    //setDither. formats of less than 8 bits get every image but RLE ones kept compressed converted into pixelData,
+    //each pixel's luma spread over the Format's levels by a 4x4 Bayer pattern instead of cut off.
+    bool dither = false;
+    //the luma of each palette index when a paletted image is dithered, indexes past a short palette
+    //get ERROR_COLOR's. 0 otherwise.
+    uint8_t * paletteLuma = 0;
+    bool dithers() { return dither && Format::bits < 8; }
+    size_t paletteLumaSize(int bits);
+    void ditherRow(const uint8_t *raw, bool bgr, int32_t y, int count, uint8_t *dst);
+    //setPremultipliedAlpha. 32bpp images with alpha are kept as 32bpp BGRA with the colors multiplied by alpha,
+    //and alphaSpans holds the first visible x and one past the last of each stored row (0, 0 for an invisible one).
+    bool premultiply = false;
+    uint16_t * alphaSpans = 0;
+    //a BI_RGB image's 4th bytes hold alpha, found by DecodeFileBuffer looking at them before the image is set up.
+    bool alphaBytes = false;
+    bool premultiplies();
+    //true when the 4th bytes of a 32bpp BI_RGB file's rows are alpha: not all 0 and not all 255.
+    bool findAlphaBytes(const uint8_t *data, int32_t length);
+    //premultiplies a loaded image in place and finds its spans.
+    BITMAP_RESULT_t premultiplyImage();
+    //blends pixels first to end - 1 of a premultiplied stored row over dst, returns how many weren't invisible.
+    int blendRow(const uint8_t *row, int first, int end, Pixel *dst);
+    //count pixels of a pixelData row starting at x0.
+    void readConverted(const uint8_t *row, int x0, int count, Pixel *dst);
+    //converts rows first to end - 1 of the file buffer arg, for one worker of DecodeFileBuffer.
+    static void convertRows(ESPBitmapBase *bitmap, void *arg, int32_t first, int32_t end, int worker);
+
+    //getFromStream's palette, and the conversion of 16, 24 and 32bpp pixel data a scanline at a time.
+    BITMAP_RESULT_t allocatePalette(size_t colors);
+    void setPaletteColor(size_t index, const uint8_t *bgra);
+    BITMAP_RESULT_t beginPixelData(size_t length);
+    void storePixelData(const uint8_t *data, size_t offset, size_t count);
+    BITMAP_RESULT_t endPixelData(size_t length);
+    //the palette goes in storage ahead of the pixel data.
+    size_t storageNeeded(size_t colors, size_t pixelLength, bool borrowed);
+    void clearImage();
+    //decode size output, converted formats take box filtered and 16, 24 and 32bpp images into pixelData.
+    BITMAP_RESULT_t allocateScaled();
+    void storeScaledRow(const uint8_t *row, int32_t index);
+    //colors of a source row for a box filtered decode size.
+    void sourceRowColors(const uint8_t *scanline, int x0, int count, PIXEL_t *dst);
+    //one scanline of direct color data being collected while loading, and how much of it is there.
+    uint8_t *loadScanline = 0;
+    size_t loadScanlineFill = 0;
+
+  public:
+    ESPBitmapT();
+    ~ESPBitmapT();
+
+    //1 and 4bpp images get a small lookup table (up to 512 pixels) so whole rows expand a byte at a time.
+    //it's kept with the image and counts towards storageCapacity, set false to save the memory.
+    //takes effect from the next image loaded.
+    void setExpandTables(bool build) { expandTables = build; }
+    //once an image is loaded by DecodeFileBuffer or getFromStream/poll, count its colors (as Pixels), and if there
+    //are 256 or fewer keep it as 1, 2, 4 or 8bpp indexes into a palette of just those, when that's smaller.
+    //getPixel, copyRow and the rest return exactly the same pixels, scanlineAt returns the repacked rows.
+    //the image moves to a new block of the smaller size, so for a moment both are held. RLE images kept
+    //compressed, borrowed buffers and ESPBitmapFile are left as they are.
+    void setRepack(bool shrink) { repack = shrink; }
+    //store 16, 24 and 32bpp images (and box filtered decode sizes) as 8bpp indexes into a palette of 256 colors,
+    //a third of ESPBitmap's memory and half of ESPBitmap16's. BITMAP_QUANTIZE_332 uses a fixed palette and is
+    //a single pass anywhere. BITMAP_QUANTIZE_MEDIAN_CUT fits the palette to the colors of the file, which
+    //DecodeFileBuffer reads twice more first with 12KB for a histogram; getFromStream/poll can't look ahead
+    //and use 332. with setRepack images that come out of it with few colors shrink further.
+    //formats of 8 bits or less are left as they are.
+    void setQuantize(BITMAP_QUANTIZE_t mode) { quantize = mode; }
+
+    //for ESPBitmapGray4, ESPBitmapGray2 and ESPBitmapMono, spread each pixel between the two nearest levels in a 4x4
+    //Bayer pattern as the image loads, so shading survives on e-paper instead of being cut off at the nearest level.
+    //paletted images are converted too (each palette entry's luma is worked out once), packed into rows of
+    //(width * bits + 7) / 8 bytes with the first pixel in the high bits, what most panels take as they are.
+    //RLE images kept compressed keep their indexes and aren't dithered, dithered images aren't repacked.
+    //takes effect from the next image loaded.
+    void setDither(bool on) { dither = on; }
+
+    //keep 32bpp images that have alpha (an alpha mask, or BI_RGB ones whose 4th bytes aren't all 0 or all 255,
+    //which only DecodeFileBuffer can look at up front) as BGRA with
+    //the colors already multiplied by alpha, so blendOnto is a multiply and an add per channel. the span of each
+    //row that isn't fully transparent is found as it loads (4 bytes a row). getPixel and the rest return the
+    //premultiplied colors, with alpha in PIXEL_t's a (255 is opaque). these stay 32bpp in every format, box
+    //filtered decode sizes and ESPBitmapFile aren't premultiplied. takes effect from the next image loaded.
+    void setPremultipliedAlpha(bool on) { premultiply = on; }
+
+    //draws the image with its top left at x, y of dst, a dstWidth by dstHeight framebuffer of Format's pixels
+    //(RGB565 for ESPBitmap16) with dstStride pixels between rows, clipped to it. a premultiplied image is blended:
+    //opaque runs are converted straight in, transparent ones and each row's invisible ends are skipped, so the
+    //cost follows the pixels that show. any other image is copied like copyRect.
+    //returns the number of pixels written.
+    int blendOnto(Pixel *dst, int dstStride, int x, int y, int dstWidth, int dstHeight);
+
+    //decodes a bitmap from a buffer array. Expects entire file to be present in the byte array
+    BITMAP_RESULT_t DecodeFileBuffer(uint8_t *wholeFileBytes, int32_t length);
+
+    Pixel getPixel(int x, int y);
+
+    //returns the raw stored row for image row y (0 is the top), decoding it first if the image is kept RLE compressed.
+    //images converted to Format when loaded have no raw rows.
+    const uint8_t *scanlineAt(int y) { return rowAt(storedRow(y)); }
+
+    //copies count pixels of row y starting at x0 into dst, much faster than calling getPixel for each.
+    //the span is clipped to the image, pixels of dst that fall outside it are left untouched.
+    //returns the number of pixels written.
+    int copyRow(int y, int x0, int count, Pixel *dst);
+    //copies a w by h block into dst, dstStride is the number of pixels between rows of dst.
+    //clipped like copyRow, returns the number of pixels written.
+    int copyRect(int x, int y, int w, int h, Pixel *dst, int dstStride);
+    //fills buffer with up to count pixels of the w by h window at x, y, in the order a display takes them once its
+    //address window is set (left to right, top to bottom), starting pos pixels into the window. buffer can be
+    //sized for one writePixels or DMA burst and refilled: call again with pos moved on by what was written.
+    //a span runs on into the next row. pixels outside the image are left untouched, like copyRow.
+    //returns the number of pixels of buffer used, 0 once pos is past the end of the window.
+    int copySpan(int x, int y, int w, int h, uint32_t pos, Pixel *buffer, int count);
+
+    Pixel ERROR_COLOR;
+
+#ifdef ESP8266
+
+  //decodes the stream one scanline at a time, without storing the image.
+  //scanLineCallBack is called once for each row with its y (0 is the top) and the decoded pixels.
+  //rows arrive in file order: top down for flipped images, bottom up otherwise.
+  //only the palette and one scanline are held in memory, and the pixel buffer is only valid during the call.
+  BITMAP_RESULT_t StreamDecode(Stream* stream, int len, int timeoutMs, void (*scanLineCallBack)(int y, Pixel *pixels, int width));
+#endif //ESP8266
+};
+
+//the formats the library is built with, see ESPBitmap.h and ESPBitmap16.h for the usual two.
+typedef ESPBitmapT<PixelRGB565Swapped> ESPBitmap16Swapped;
+typedef ESPBitmapT<PixelGray8> ESPBitmapGray;
+typedef ESPBitmapT<PixelGray4> ESPBitmapGray4;
+typedef ESPBitmapT<PixelGray2> ESPBitmapGray2;
+typedef ESPBitmapT<PixelMono1> ESPBitmapMono;
+
+#endif /*_ESPBITMAPT_H_*/
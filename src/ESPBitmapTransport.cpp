@@ -0,0 +1,39 @@
+/*
+ESPBitmap Library
+Copyright 2018 Rickey Ward
+
+MIT License
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom
+the Software is furnished to do so, subject to the following conditions: The
+above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED "AS
+IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ESPBitmapTransport.h"
+
+#ifdef ESP8266
+
+int ESPBitmapHTTPTransport::get(const String &url, const String &etag, const String &lastModified)
+{
+  http.begin(url);
+  if(etag.length() > 0)
+    http.addHeader("If-None-Match", etag);
+  if(lastModified.length() > 0)
+    http.addHeader("If-Modified-Since", lastModified);
+  //HTTPClient only keeps the response headers it's asked for.
+  const char *validators[] = { "ETag", "Last-Modified" };
+  http.collectHeaders(validators, 2);
+  return http.GET();
+}
+
+#endif //ESP8266
@@ -0,0 +1,65 @@
+/*
+ESPBitmap Library
+Copyright 2018 Rickey Ward
+
+MIT License
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom
+the Software is furnished to do so, subject to the following conditions: The
+above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software. THE SOFTWARE IS PROVIDED "AS
+IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _ESPBITMAPTRANSPORT_H_
+#define _ESPBITMAPTRANSPORT_H_
+
+#ifdef ESP8266
+
+#include <Arduino.h>
+#include <ESP8266HTTPClient.h>
+
+//how fetchImageFromUrl talks to a server, one request at a time.
+//ESPBitmapHTTPTransport is the default, set your own with setTransport (https, a proxy, a stand-in for testing...).
+class ESPBitmapTransport
+{
+  public:
+    virtual ~ESPBitmapTransport() {}
+    //sends a GET for url, conditional (If-None-Match, If-Modified-Since) when etag or lastModified aren't empty.
+    //returns the http status code, 304 means the copy we have is still current. negative if it failed.
+    virtual int get(const String &url, const String &etag, const String &lastModified) = 0;
+    //after a 200, the body, its length (-1 if unknown) and the validators the server sent with it.
+    virtual Stream *stream() = 0;
+    virtual int size() = 0;
+    virtual String etag() = 0;
+    virtual String lastModified() = 0;
+    //done with the response.
+    virtual void end() = 0;
+};
+
+//ESPBitmapTransport over the ESP8266 core's HTTPClient.
+class ESPBitmapHTTPTransport : public ESPBitmapTransport
+{
+  public:
+    int get(const String &url, const String &etag, const String &lastModified);
+    Stream *stream() { return http.getStreamPtr(); }
+    int size() { return http.getSize(); }
+    String etag() { return http.header("ETag"); }
+    String lastModified() { return http.header("Last-Modified"); }
+    void end() { http.end(); }
+
+  private:
+    HTTPClient http;
+};
+
+#endif //ESP8266
+
+#endif /*_ESPBITMAPTRANSPORT_H_*/